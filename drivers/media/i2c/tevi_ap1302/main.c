@@ -1,4 +1,6 @@
 #include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
 #include <linux/uaccess.h>
 #include <linux/gpio.h>
 #include <linux/module.h>
@@ -94,6 +96,11 @@ static const struct of_device_id sensor_of_match[] = {
 };
 MODULE_DEVICE_TABLE(of, sensor_of_match);
 
+static bool reuse_bootdata;
+module_param(reuse_bootdata, bool, 0644);
+MODULE_PARM_DESC(reuse_bootdata,
+		 "Skip the bootdata upload on probe if the AP1302 already runs it (rel419 firmware only, other firmware always reloads)");
+
 static const u32 ctrl_cid_list[] = {
 	TEGRA_CAMERA_CID_FRAME_RATE,
 	TEGRA_CAMERA_CID_SENSOR_MODE_ID,
@@ -104,8 +111,6 @@ struct sensor_obj {
 	struct camera_common_data	*s_data;
 	struct tegracam_device		*tc_dev;
 	struct otp_flash		*otp_flash_instance;
-	struct header_ver2 *header;
-	struct header_ver3 *headerv3;
 	int exp_gpio;
 	int info_gpio;
 	u8 selected_mode;
@@ -1575,51 +1580,78 @@ static int sensor_load_bootdata(struct sensor_obj *priv)
 	int index = 0;
 
 	u16 otp_data;
-	u16 *bootdata_temp_area;
+	u8 *bootdata;
+	u8 *bootdata_temp_area;
 	u16 checksum;
-	int i;
-	const int len_each_time = 1024;
-	size_t len = len_each_time;
+	size_t total;
+	size_t len;
+	size_t len_each_time;
+	ktime_t start, read_end, write_end;
+	s64 read_us, write_us, wait_us;
+	int ret = 0;
 
-	bootdata_temp_area = devm_kzalloc(dev,
-					  len_each_time * 4 + 2,
-					  GFP_KERNEL);
-	if (bootdata_temp_area == NULL) {
-		dev_err(dev, "allocate memory failed\n");
+	total = tevi_ap1302_otp_flash_get_length(priv->otp_flash_instance);
+	checksum = tevi_ap1302_otp_flash_get_checksum(priv->otp_flash_instance);
+	if (total == 0 || total > BOOT_DATA_MAX_LEN) {
+		dev_err(dev, "bootdata length %zu out of range\n", total);
 		return -EINVAL;
 	}
+	len_each_time = tn_otp_bootdata_chunk_len(priv->tc_dev->client,
+						  BOOT_DATA_WRITE_LEN);
+	dev_dbg(dev, "bootdata burst length %zu\n", len_each_time);
+
+	/*
+	 * The flash and the AP1302 share one bus, so transfers to them can't
+	 * overlap. Fetch the whole content first in large sequential reads
+	 * and then stream it to the ISP without going back to the flash.
+	 */
+	bootdata = kvmalloc(total, GFP_KERNEL);
+	bootdata_temp_area = kmalloc(len_each_time + 2, GFP_KERNEL);
+	if (bootdata == NULL || bootdata_temp_area == NULL) {
+		dev_err(dev, "allocate memory failed\n");
+		ret = -ENOMEM;
+		goto out;
+	}
 
-	checksum = tevi_ap1302_otp_flash_get_checksum(priv->otp_flash_instance);
+	start = ktime_get();
+	while (index < total) {
+		len = tevi_ap1302_otp_flash_read(priv->otp_flash_instance,
+						 &bootdata[index], index,
+						 total - index);
+		if (len == 0) {
+			dev_err(dev, "read bootdata failed at %d\n", index);
+			ret = -EIO;
+			goto out;
+		}
+		index += len;
+	}
+	read_end = ktime_get();
 
 	//load bootdata ronaming
-	while(len != 0) {
-		while(i < BOOT_DATA_WRITE_LEN) {
-			bootdata_temp_area[0] =
-				cpu_to_be16(BOOT_DATA_START_REG + i);
-			len = tevi_ap1302_otp_flash_read(priv->otp_flash_instance,
-					     (u8 *)(&bootdata_temp_area[1]),
-					     index, len_each_time);
-			if (len == 0) {
-				dev_dbg(dev, "length get zero\n");
-				break;
-			}
-
-			dev_dbg(dev,
-				"load ronaming data of length [%zu] into register [%x]\n",
-				len,
-				BOOT_DATA_START_REG + i);
-			sensor_i2c_write_bust(priv->tc_dev->client,
-					 (u8 *)bootdata_temp_area,
-					 len + 2);
-			index += len;
-			i += len_each_time;
+	for (index = 0; index < total; index += len) {
+		u16 reg = BOOT_DATA_START_REG + index % BOOT_DATA_WRITE_LEN;
+
+		len = min(len_each_time, total - index);
+		len = min_t(size_t, len,
+			    BOOT_DATA_WRITE_LEN - index % BOOT_DATA_WRITE_LEN);
+
+		bootdata_temp_area[0] = reg >> 8;
+		bootdata_temp_area[1] = reg & 0xff;
+		memcpy(&bootdata_temp_area[2], &bootdata[index], len);
+
+		dev_dbg(dev,
+			"load ronaming data of length [%zu] into register [%x]\n",
+			len, reg);
+		ret = sensor_i2c_write_bust(priv->tc_dev->client,
+					    bootdata_temp_area, len + 2);
+		if (ret) {
+			dev_err(dev, "write bootdata failed at %d\n", index);
+			goto out;
 		}
-
-		i = 0;
 	}
+	write_end = ktime_get();
 
 	sensor_i2c_write_16b(priv->tc_dev->client, 0x6002, 0xffff);
-	devm_kfree(dev, bootdata_temp_area);
 
 	msleep(500);
 
@@ -1636,10 +1668,56 @@ static int sensor_load_bootdata(struct sensor_obj *priv)
 		else
 			dev_err(dev, "bootdata checksum missmatch\n");
 
-		return -EINVAL;
+		ret = -EINVAL;
+		goto out;
 	}
 
-	return 0;
+	read_us = max_t(s64, ktime_us_delta(read_end, start), 1);
+	write_us = max_t(s64, ktime_us_delta(write_end, read_end), 1);
+	wait_us = ktime_us_delta(ktime_get(), write_end);
+	dev_info(dev, "bootdata %zu bytes loaded in %lld ms (read %lld ms %lld KB/s, write %lld ms %lld KB/s, boot %lld ms)\n",
+		 total, (read_us + write_us + wait_us) / 1000,
+		 read_us / 1000, (s64)total * 1000 / read_us,
+		 write_us / 1000, (s64)total * 1000 / write_us,
+		 wait_us / 1000);
+
+out:
+	kfree(bootdata_temp_area);
+	kvfree(bootdata);
+	return ret;
+}
+
+static void sensor_reset_assert(struct camera_common_power_rail *pw)
+{
+	gpio_set_value_cansleep(pw->reset_gpio, 0);
+	gpio_set_value_cansleep(pw->pwdn_gpio, 1);
+	msleep(200);
+}
+
+static void sensor_reset_release(struct camera_common_power_rail *pw)
+{
+	gpio_set_value_cansleep(pw->pwdn_gpio, 0);
+	msleep(500);
+	gpio_set_value_cansleep(pw->reset_gpio, 1);
+	msleep(300);
+}
+
+/* Only rel419 firmware can be matched, see tn_otp_ap1302_bootdata_loaded() */
+static bool sensor_bootdata_loaded(struct sensor_obj *priv)
+{
+	struct i2c_client *client = priv->tc_dev->client;
+	u16 checksum;
+
+	checksum = tevi_ap1302_otp_flash_get_checksum(priv->otp_flash_instance);
+	if (!tn_otp_ap1302_bootdata_loaded(client, checksum))
+		return false;
+
+	if (sensor_standby(client, 0) != 0)
+		return false;
+
+	dev_info(&client->dev, "bootdata %x already loaded, skip upload\n",
+		 checksum);
+	return true;
 }
 
 static int sensor_board_setup(struct sensor_obj *priv)
@@ -1651,8 +1729,8 @@ static int sensor_board_setup(struct sensor_obj *priv)
 	int data_lanes;
 	int continuous_clock;
 	bool has_rpi = false;
+	bool warm;
 	int i;
-	u8* header_ptr;
 	u16 chipid = 0;
 	int err = 0;
 
@@ -1670,9 +1748,9 @@ static int sensor_board_setup(struct sensor_obj *priv)
 		goto done;
 	}
 
-	gpio_set_value_cansleep(pw->reset_gpio, 0);
-	gpio_set_value_cansleep(pw->pwdn_gpio, 1);
-	msleep(200);
+	warm = reuse_bootdata && tn_otp_ap1302_alive(priv->tc_dev->client);
+	if (!warm)
+		sensor_reset_assert(pw);
 
 	has_rpi = of_property_read_bool(dev->of_node, "has-rpi-adapter");
 	if(has_rpi) {
@@ -1695,10 +1773,8 @@ static int sensor_board_setup(struct sensor_obj *priv)
 		gpio_set_value_cansleep(priv->exp_gpio, 1);
 		gpio_set_value_cansleep(priv->info_gpio, 1);
 	}
-	gpio_set_value_cansleep(pw->pwdn_gpio, 0);
-	msleep(500);
-	gpio_set_value_cansleep(pw->reset_gpio, 1);
-	msleep(300);
+	if (!warm)
+		sensor_reset_release(pw);
 
 	err = sensor_i2c_read_16b(priv->tc_dev->client, 0, &chipid);
 	if (err) {
@@ -1738,28 +1814,13 @@ static int sensor_board_setup(struct sensor_obj *priv)
 		goto err_reg_probe;
 	}
 
-	header_ptr = (u8*)priv->otp_flash_instance->header_data;
-
-	if(header_ptr[0] == 2) {
-		priv->header = priv->otp_flash_instance->header_data;
-		for(i = 0 ; i < ARRAY_SIZE(ap1302_sensor_table); i++)
-		{
-			if (strcmp((const char*)priv->header->product_name, ap1302_sensor_table[i].sensor_name) == 0)
-				break;
-		}
-		priv->selected_sensor = i;
-		dev_info(dev, "selected_sensor:%d, sensor_name:%s\n", i, priv->header->product_name);
-	}
-	else if(header_ptr[0] == 3) {
-		priv->headerv3 = priv->otp_flash_instance->header_data;
-		for(i = 0 ; i < ARRAY_SIZE(ap1302_sensor_table); i++)
-		{
-			if (strcmp((const char*)priv->headerv3->product_name, ap1302_sensor_table[i].sensor_name) == 0)
-				break;
-		}
-		priv->selected_sensor = i;
-		dev_info(dev, "selected_sensor:%d, sensor_name:%s\n", i, priv->headerv3->product_name);
+	for(i = 0 ; i < ARRAY_SIZE(ap1302_sensor_table); i++)
+	{
+		if (strcmp(priv->otp_flash_instance->product_name, ap1302_sensor_table[i].sensor_name) == 0)
+			break;
 	}
+	priv->selected_sensor = i;
+	dev_info(dev, "selected_sensor:%d, sensor_name:%s\n", i, priv->otp_flash_instance->product_name);
 
 	switch(priv->selected_sensor){
 	case TEVI_AP1302_AR0144:
@@ -1796,7 +1857,13 @@ static int sensor_board_setup(struct sensor_obj *priv)
 		break;
 	}
 
-	if(sensor_load_bootdata(priv) != 0) {
+	if (warm && !sensor_bootdata_loaded(priv)) {
+		sensor_reset_assert(pw);
+		sensor_reset_release(pw);
+		warm = false;
+	}
+
+	if(!warm && sensor_load_bootdata(priv) != 0) {
 		err = -EINVAL;
 		dev_err(dev, "load bootdata failed\n");
 		goto err_reg_probe;
@@ -15,6 +15,11 @@ u16 tevi_ap1302_otp_flash_get_checksum(struct otp_flash *instance)
 	return BOOTDATA_CHECKSUM;
 }
 
+size_t tevi_ap1302_otp_flash_get_length(struct otp_flash *instance)
+{
+	return BOOTDATA_TOTAL_SIZE;
+}
+
 size_t tevi_ap1302_otp_flash_read(struct otp_flash *instance, u8 *data, int addr, size_t len)
 {
 	size_t l;
@@ -66,10 +71,9 @@ struct otp_flash *tevi_ap1302_otp_flash_init(struct i2c_client *client)
 {
 	struct otp_flash *instance;
 	struct device *dev = &client->dev;
-	u8 __header_ver;
-	struct header_ver2 *header;
-	struct header_ver3 *headerv3;
-	// int ret;
+	struct tn_otp_header *header;
+	u8 raw[TN_OTP_HEADER_MAX_LEN];
+	int ret;
 
 	instance = devm_kzalloc(dev, sizeof(struct otp_flash), GFP_KERNEL);
 	if (instance == NULL) {
@@ -87,19 +91,18 @@ struct otp_flash *tevi_ap1302_otp_flash_init(struct i2c_client *client)
 		goto fail;
 	}
 
-	nvmem_device_read(instance->nvmem, 0, 1, &__header_ver);
-
-	if (__header_ver == 2) {
-		instance->header_data = devm_kzalloc(dev,
-				      sizeof(struct header_ver2),
-				      GFP_KERNEL);
+	ret = nvmem_device_read(instance->nvmem, 0, sizeof(raw), raw);
+	if (ret < 0) {
+		dev_err(dev, "read otp header failed: %d\n", ret);
+		goto fail;
+	}
 
-		nvmem_device_read(instance->nvmem,
-				  0,
-				  sizeof(struct header_ver2),
-				  instance->header_data);
+	header = &instance->header;
+	if (tn_otp_parse_header(dev, raw, ret, header) != 0)
+		goto fail;
 
-		header = instance->header_data;
+	instance->product_name = header->product_name;
+	if (header->header_version == TN_OTP_HEADER_VER2) {
 		dev_info(dev, "Product:%s, Version:%d Lens:%s, Version:%d\n",
 			 header->product_name,
 			 header->product_version,
@@ -110,40 +113,22 @@ struct otp_flash *tevi_ap1302_otp_flash_init(struct i2c_client *client)
 			header->content_version, header->content_checksum);
 		dev_dbg(dev, "content length: %d, pll bootdata length: %d\n",
 			header->content_len, header->pll_bootdata_len);
-
-		return instance;
-
-	} 
-	else if(__header_ver == 3) {
-		instance->header_data =
-			devm_kzalloc(dev, sizeof(struct header_ver3),
-				     GFP_KERNEL);
-
-		nvmem_device_read(instance->nvmem,
-				  0,
-				  sizeof(struct header_ver3),
-				  instance->header_data);
-
-		headerv3 = instance->header_data;
-		instance->product_name = headerv3->product_name;
+	} else {
 		dev_info(dev, "Product:%s, HeaderVer:%d, Version:%d.%d.%d.%d, MIPI_Rate:%d\n",
-			 headerv3->product_name,
-			 headerv3->header_version,
-			 headerv3->tn_fw_version[0],
-			 headerv3->tn_fw_version[1],
-			 headerv3->vendor_fw_version,
-			 headerv3->custom_number,
-			 headerv3->mipi_datarate);
+			 header->product_name,
+			 header->header_version,
+			 header->tn_fw_version[0],
+			 header->tn_fw_version[1],
+			 header->vendor_fw_version,
+			 header->custom_number,
+			 header->mipi_datarate);
 
 		dev_dbg(dev, "content checksum: %x, content length: %d\n",
-				headerv3->content_checksum, headerv3->content_len);
-
-		return instance;
-	}
-	else {
-		dev_err(dev, "can't recognize header version number '0x%X'\n",
-			__header_ver);
+				header->content_checksum, header->content_len);
 	}
+
+	return instance;
+
 fail:
 	devm_kfree(dev, instance);
 	return ERR_PTR(-EINVAL);
@@ -151,53 +136,28 @@ fail:
 
 u16 tevi_ap1302_otp_flash_get_checksum(struct otp_flash *instance)
 {
-	struct header_ver2 *header;
-	struct header_ver3 *headerv3;
-
-	if( ((u8*)instance->header_data)[0] == 2 ) {
-		header = (struct header_ver2 *)instance->header_data;
-		return header->content_checksum;
-	}
-	else if(((u8*)instance->header_data)[0] == 3 ) {
-		headerv3 = (struct header_ver3 *)instance->header_data;
-		return headerv3->content_checksum;
-	}
+	return instance->header.content_checksum;
+}
 
-	return 0xffff;
+size_t tevi_ap1302_otp_flash_get_length(struct otp_flash *instance)
+{
+	return instance->header.content_len;
 }
 
 size_t tevi_ap1302_otp_flash_read(struct otp_flash *instance, u8 *data, int addr, size_t len)
 {
-	u8 *temp;
-	struct header_ver2 *header;
-	struct header_ver3 *headerv3;
+	struct tn_otp_header *header = &instance->header;
 	size_t l;
 
-	temp = (u8*)instance->header_data;
-	if(temp[0] == 2) {
-		header = (struct header_ver2 *)instance->header_data;
-		l = len > BOOT_DATA_WRITE_LEN ? BOOT_DATA_WRITE_LEN : len;
-		l = (header->content_len - addr) < l ? header->content_len - addr : l;
-
-		nvmem_device_read(instance->nvmem,
-				  addr + header->content_offset,
-				  l,
-				  data);
-		return l;
-	}
-	else if(temp[0] == 3) {
-		headerv3 = (struct header_ver3 *)instance->header_data;
-		l = len > BOOT_DATA_WRITE_LEN ? BOOT_DATA_WRITE_LEN : len;
-		l = (headerv3->content_len - addr) < l ? headerv3->content_len - addr : l;
-
-		nvmem_device_read(instance->nvmem,
-				  addr + headerv3->content_offset,
-				  l,
-				  data);
-		return l;
-	}
+	l = len > BOOT_DATA_WRITE_LEN ? BOOT_DATA_WRITE_LEN : len;
+	l = (header->content_len - addr) < l ? header->content_len - addr : l;
 
-	return 0;
+	if (nvmem_device_read(instance->nvmem,
+			      addr + header->content_offset,
+			      l,
+			      data) < 0)
+		return 0;
+	return l;
 }
 
 #endif
@@ -12,6 +12,7 @@
 #include <media/tegracam_core.h>
 
 #include "otp_flash.h"
+#include "../tn_otp/tn_otp.h"
 
 #define AP1302_BRIGHTNESS						(0x7000)
 #define AP1302_BRIGHTNESS_MASK					(0xFFFF)
@@ -94,6 +95,11 @@ static const struct of_device_id __of_match[] = {
 };
 MODULE_DEVICE_TABLE(of, __of_match);
 
+static bool reuse_bootdata;
+module_param(reuse_bootdata, bool, 0644);
+MODULE_PARM_DESC(reuse_bootdata,
+		 "Skip the bootdata upload on probe if the AP1302 already runs it (rel419 firmware only, other firmware always reloads)");
+
 /*
  * WARNING: frmfmt ordering need to match mode definition in
  * device tree!
@@ -939,50 +945,57 @@ static int sensor_load_bootdata(struct sensor_obj *priv)
 	int index = 0;
 
 	u16 otp_data;
-	u16 *bootdata_temp_area;
+	u8 *bootdata_temp_area;
 	u16 checksum;
-	int i;
-	const int len_each_time = 1024;
-	size_t len = len_each_time;
+	size_t len_each_time;
+	size_t len;
+	u16 reg;
+	int ret;
+
+	len_each_time = tn_otp_bootdata_chunk_len(priv->tc_dev->client,
+						  BOOT_DATA_WRITE_LEN);
+	dev_dbg(dev, "bootdata burst length %zu\n", len_each_time);
 
-	bootdata_temp_area = devm_kzalloc(dev,
-					  len_each_time * 4 + 2,
-					  GFP_KERNEL);
+	bootdata_temp_area = kmalloc(len_each_time + 2, GFP_KERNEL);
 	if (bootdata_temp_area == NULL) {
 		dev_err(dev, "allocate memory failed\n");
-		return -EINVAL;
+		return -ENOMEM;
 	}
 
 	checksum = tevi_ar0144_otp_flash_get_checksum(priv->otp_flash_instance);
 
-	while(len != 0) {
-		while(i < BOOT_DATA_WRITE_LEN) {
-			bootdata_temp_area[0] =
-				cpu_to_be16(BOOT_DATA_START_REG + i);
-			len = tevi_ar0144_otp_flash_read(priv->otp_flash_instance,
-					     (u8 *)(&bootdata_temp_area[1]),
-					     index, len_each_time);
-			if (len == 0) {
-				dev_dbg(dev, "length get zero\n");
-				break;
-			}
+	for (;;) {
+		reg = BOOT_DATA_START_REG + index % BOOT_DATA_WRITE_LEN;
+		len = min_t(size_t, len_each_time,
+			    BOOT_DATA_WRITE_LEN - index % BOOT_DATA_WRITE_LEN);
 
-			dev_dbg(dev,
-				"load ronaming data of length [%zu] into register [%x]\n",
-				len,
-				BOOT_DATA_START_REG + i);
-			__i2c_write_bust(priv->tc_dev->client,
-					 (u8 *)bootdata_temp_area,
-					 len + 2);
-			index += len;
-			i += len_each_time;
+		len = tevi_ar0144_otp_flash_read(priv->otp_flash_instance,
+				     &bootdata_temp_area[2],
+				     index, len);
+		if (len == 0) {
+			dev_dbg(dev, "length get zero\n");
+			break;
 		}
 
-		i = 0;
+		bootdata_temp_area[0] = reg >> 8;
+		bootdata_temp_area[1] = reg & 0xff;
+
+		dev_dbg(dev,
+			"load ronaming data of length [%zu] into register [%x]\n",
+			len, reg);
+		ret = __i2c_write_bust(priv->tc_dev->client,
+				       bootdata_temp_area, len + 2);
+		if (ret) {
+			dev_err(dev, "write bootdata failed at %d\n", index);
+			kfree(bootdata_temp_area);
+			return ret;
+		}
+		index += len;
 	}
 
+	kfree(bootdata_temp_area);
+
 	__i2c_write_16b(priv->tc_dev->client, 0x6002, 0xffff);
-	devm_kfree(dev, bootdata_temp_area);
 
 	msleep(500);
 
@@ -1909,6 +1922,32 @@ static int sensor_ctrls_init(struct sensor_obj *priv)
 	return 0;
 }
 
+static void sensor_reset(struct camera_common_power_rail *pw)
+{
+	gpio_set_value_cansleep(pw->reset_gpio, 0);
+	msleep(500);
+	gpio_set_value_cansleep(pw->reset_gpio, 1);
+	msleep(500);
+}
+
+/* Only rel419 firmware can be matched, see tn_otp_ap1302_bootdata_loaded() */
+static bool sensor_bootdata_loaded(struct sensor_obj *priv)
+{
+	struct i2c_client *client = priv->tc_dev->client;
+	u16 checksum;
+
+	checksum = tevi_ar0144_otp_flash_get_checksum(priv->otp_flash_instance);
+	if (!tn_otp_ap1302_bootdata_loaded(client, checksum))
+		return false;
+
+	if (sensor_standby(client, 0) != 0)
+		return false;
+
+	dev_info(&client->dev, "bootdata %x already loaded, skip upload\n",
+		 checksum);
+	return true;
+}
+
 static int sensor_board_setup(struct sensor_obj *priv)
 {
 	struct camera_common_data *s_data = priv->s_data;
@@ -1917,6 +1956,7 @@ static int sensor_board_setup(struct sensor_obj *priv)
 	struct device *dev = s_data->dev;
 	u16 chipid = 0;
 	u32  port_idx = priv->vc_id;
+	bool warm;
 	int err = 0;
 
 	if (pdata->mclk_name) {
@@ -1927,12 +1967,17 @@ static int sensor_board_setup(struct sensor_obj *priv)
 		}
 	}
 
+	warm = reuse_bootdata && tn_otp_ap1302_alive(priv->tc_dev->client);
+
 	if (!(pw->reset_gpio && pw->pwdn_gpio)) {
 		dev_err(dev, "error the power and reset gpio define\n");
 		err = -EIO;
 		goto pass;
 	}
 
+	if (warm)
+		goto pass;
+
 	gpio_set_value_cansleep(pw->reset_gpio, 0);
 	// gpio_set_value_cansleep(pw->pwdn_gpio, 1);
 	msleep(500);
@@ -1949,7 +1994,8 @@ static int sensor_board_setup(struct sensor_obj *priv)
 	// }
 	gpio_set_value_cansleep(pw->reset_gpio, 1);
 pass:
-	msleep(500);
+	if (!warm)
+		msleep(500);
 
 	err = ar0144_i2c_read_16b(priv->tc_dev->client, 0, &chipid);
 	if (err) {
@@ -1972,7 +2018,13 @@ pass:
 		goto err_reg_probe;
 	}
 
-	if(sensor_load_bootdata(priv) != 0) {
+	if (warm && !sensor_bootdata_loaded(priv)) {
+		if (pw->reset_gpio && pw->pwdn_gpio)
+			sensor_reset(pw);
+		warm = false;
+	}
+
+	if(!warm && sensor_load_bootdata(priv) != 0) {
 		err = -EINVAL;
 		dev_err(dev, "load bootdata failed\n");
 		goto err_reg_probe;
@@ -1,10 +1,11 @@
 #define DEBUG
 #include <linux/i2c.h>
 #include "otp_flash.h"
+#include "../tn_otp/tn_otp.h"
 
 struct otp_flash {
 	struct i2c_client *client;
-	void *header_data;
+	struct tn_otp_header header;
 };
 
 #ifndef __FAKE__
@@ -42,33 +43,6 @@ size_t tevi_ar0144_otp_flash_get_pll_section(struct otp_flash *instance, u8 *dat
 	return BOOTDATA_PLL_INIT_SIZE;
 }
 #else
-/*
-header Version 2 : {
-	uint8 header_version
-	uint16 content_offset //content_offset may not be equal to the size of header
-	uint8 product_name[64]
-	uint8 product_version
-	uint8 lens_name[64]
-	uint8 lens_version
-	uint8 content_version
-	uint32 content_checksum
-	uint32 content_len
-	uint16 pll_bootdata_len
-}
-*/
-struct header_ver2 {
-	u8 header_version;
-	u16 content_offset;
-	u8 product_name[64];
-	u8 product_version;
-	u8 lens_name[64];
-	u8 lens_version;
-	u8 content_version;
-	u32 content_checksum;
-	u32 content_len;
-	u16 pll_bootdata_len;
-} __attribute__((packed));
-
 static int tevi_ar0144_otp_read(struct i2c_client *client, u32 reg, u16 size, u8 *val)
 {
 	struct i2c_msg msg[2];
@@ -97,118 +71,80 @@ struct otp_flash *tevi_ar0144_otp_flash_init(struct i2c_client *client)
 {
 	struct otp_flash *instance;
 	struct device *dev = &client->dev;
-	u8 __header_ver;
-	struct header_ver2 *header;
+	struct tn_otp_header *header;
+	u8 raw[TN_OTP_HEADER_MAX_LEN];
 	int ret;
 
-	ret = tevi_ar0144_otp_read(client, 0, 1, &__header_ver);
+	ret = tevi_ar0144_otp_read(client, 0, sizeof(raw), raw);
 	if (ret < 0)
 		return ERR_PTR(ret);
 
-	if (__header_ver == 2) {
-		header = devm_kzalloc(dev,
-				      sizeof(struct header_ver2),
-				      GFP_KERNEL);
-		if (header == NULL) {
-			dev_err(dev, "allocate memory failed\n");
-			return ERR_PTR(-ENOMEM);
-		}
-
-		tevi_ar0144_otp_read(client,
-			   0,
-			   sizeof(struct header_ver2),
-			   (u8 *)header);
-
-		dev_info(dev, "Product:%s, Version:%d Lens:%s, Version:%d\n",
-			 header->product_name,
-			 header->product_version,
-			 header->lens_name,
-			 header->lens_version);
-
-		dev_dbg(dev, "content ver: %d, content checksum: %x\n",
-			header->content_version, header->content_checksum);
-		dev_dbg(dev, "content length: %d, pll bootdata length: %d\n",
-			header->content_len, header->pll_bootdata_len);
-
-		instance = devm_kzalloc(dev, sizeof(struct otp_flash), GFP_KERNEL);
-		if (instance == NULL) {
-			dev_err(dev, "allocate memory failed\n");
-			return ERR_PTR(-ENOMEM);
-		}
-
-		instance->client = client;
-		instance->header_data = header;
-		return instance;
-
-	} else {
+	instance = devm_kzalloc(dev, sizeof(struct otp_flash), GFP_KERNEL);
+	if (instance == NULL) {
+		dev_err(dev, "allocate memory failed\n");
+		return ERR_PTR(-ENOMEM);
+	}
+
+	header = &instance->header;
+	ret = tn_otp_parse_header(dev, raw, sizeof(raw), header);
+	if (ret) {
+		devm_kfree(dev, instance);
+		return ERR_PTR(ret);
+	}
+
+	if (header->header_version != TN_OTP_HEADER_VER2) {
 		dev_err(dev, "can't recognize header version number '0x%X'\n",
-			__header_ver);
+			header->header_version);
+		devm_kfree(dev, instance);
+		return ERR_PTR(-EINVAL);
 	}
 
-	return ERR_PTR(-EINVAL);
+	dev_info(dev, "Product:%s, Version:%d Lens:%s, Version:%d\n",
+		 header->product_name,
+		 header->product_version,
+		 header->lens_name,
+		 header->lens_version);
+
+	dev_dbg(dev, "content ver: %d, content checksum: %x\n",
+		header->content_version, header->content_checksum);
+	dev_dbg(dev, "content length: %d, pll bootdata length: %d\n",
+		header->content_len, header->pll_bootdata_len);
+
+	instance->client = client;
+	return instance;
 }
 
 u16 tevi_ar0144_otp_flash_get_checksum(struct otp_flash *instance)
 {
-	struct header_ver2 *header;
-
-	if( ((u8*)instance->header_data)[0] == 2 ) {
-		header = (struct header_ver2 *)instance->header_data;
-		return header->content_checksum;
-	}
-
-	return 0xffff;
+	return instance->header.content_checksum;
 }
 
 size_t tevi_ar0144_otp_flash_read(struct otp_flash *instance, u8 *data, int addr, size_t len)
 {
-	u8 *temp;
-	struct header_ver2 *header;
+	struct tn_otp_header *header = &instance->header;
 	size_t l;
 
-	temp = (u8*)instance->header_data;
-	if(temp[0] == 2) {
-		header = (struct header_ver2 *)instance->header_data;
-		l = len > BOOT_DATA_WRITE_LEN ? BOOT_DATA_WRITE_LEN : len;
-		l = (header->content_len - addr) < l ? header->content_len - addr : l;
-
-		tevi_ar0144_otp_read(instance->client, addr + header->content_offset, l, data);
-		return l;
-	}
+	l = len > BOOT_DATA_WRITE_LEN ? BOOT_DATA_WRITE_LEN : len;
+	l = (header->content_len - addr) < l ? header->content_len - addr : l;
 
-	return 0;
+	tevi_ar0144_otp_read(instance->client, addr + header->content_offset, l, data);
+	return l;
 }
 
 size_t tevi_ar0144_otp_flash_get_pll_length(struct otp_flash *instance)
 {
-	u8 *temp;
-	struct header_ver2 *header;
-
-	temp = (u8*)instance->header_data;
-	if(temp[0] == 2) {
-		header = (struct header_ver2 *)instance->header_data;
-		return header->pll_bootdata_len;
-	}
-
-	return 0;
+	return instance->header.pll_bootdata_len;
 }
 
 size_t tevi_ar0144_otp_flash_get_pll_section(struct otp_flash *instance, u8 *data)
 {
-	u8 *temp;
-	struct header_ver2 *header;
-
-	temp = (u8*)instance->header_data;
-	if(temp[0] == 2) {
-		header = (struct header_ver2 *)instance->header_data;
-		if (header->pll_bootdata_len != 0) {
-			tevi_ar0144_otp_flash_read(instance, data, 0,
-				       header->pll_bootdata_len);
-		}
-		return header->pll_bootdata_len;
-	}
+	struct tn_otp_header *header = &instance->header;
 
-	return 0;
+	if (header->pll_bootdata_len != 0) {
+		tevi_ar0144_otp_flash_read(instance, data, 0,
+			       header->pll_bootdata_len);
+	}
+	return header->pll_bootdata_len;
 }
 
 #endif
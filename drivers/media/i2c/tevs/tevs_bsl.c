@@ -0,0 +1,236 @@
+#include <asm/unaligned.h>
+#include <linux/delay.h>
+#include <linux/jiffies.h>
+#include <linux/slab.h>
+
+#include "tevs_bsl.h"
+
+#define TEVS_BSL_HEADER			(0x80)
+#define TEVS_BSL_RESPONSE_HEADER	(0x08)
+#define TEVS_BSL_ACK			(0x00)
+
+/* Commands */
+#define TEVS_BSL_CMD_CONNECTION		(0x12)
+#define TEVS_BSL_CMD_MASS_ERASE		(0x15)
+#define TEVS_BSL_CMD_GET_DEVICE_INFO	(0x19)
+#define TEVS_BSL_CMD_PROGRAM_DATA	(0x20)
+#define TEVS_BSL_CMD_UNLOCK		(0x21)
+#define TEVS_BSL_CMD_VERIFY		(0x26)
+#define TEVS_BSL_CMD_START_APP		(0x40)
+
+/* Responses */
+#define TEVS_BSL_RSP_DEVICE_INFO	(0x31)
+#define TEVS_BSL_RSP_VERIFY		(0x32)
+#define TEVS_BSL_RSP_MESSAGE		(0x3B)
+
+#define TEVS_BSL_DEVICE_INFO_LEN	(25)
+#define TEVS_BSL_DEVICE_INFO_BUF_SIZE	(11)
+#define TEVS_BSL_RESPONSE_TIMEOUT_MS	(2000)
+
+static int tevs_bsl_send(struct i2c_client *client, u8 cmd,
+			 const u8 *data, size_t len, size_t pad)
+{
+	size_t core = 1 + len + pad;
+	u8 *pkt;
+	u32 crc;
+	u8 ack;
+	int ret;
+
+	pkt = kmalloc(core + TEVS_BSL_PACKET_OVERHEAD - 1, GFP_KERNEL);
+	if (pkt == NULL)
+		return -ENOMEM;
+
+	pkt[0] = TEVS_BSL_HEADER;
+	pkt[1] = core & 0xFF;
+	pkt[2] = core >> 8;
+	pkt[3] = cmd;
+	if (len)
+		memcpy(&pkt[4], data, len);
+	memset(&pkt[4 + len], 0xFF, pad);
+	crc = tevs_bsl_crc32(TEVS_BSL_CRC32_INIT, &pkt[3], core);
+	put_unaligned_le32(crc, &pkt[3 + core]);
+
+	ret = i2c_master_send(client, pkt, core + TEVS_BSL_PACKET_OVERHEAD - 1);
+	kfree(pkt);
+	if (ret < 0) {
+		dev_err(&client->dev, "bsl: send cmd 0x%02x failed: %d\n",
+			cmd, ret);
+		return ret;
+	}
+
+	ret = i2c_master_recv(client, &ack, 1);
+	if (ret < 0) {
+		dev_err(&client->dev, "bsl: no ack for cmd 0x%02x: %d\n",
+			cmd, ret);
+		return ret;
+	}
+	if (ack != TEVS_BSL_ACK) {
+		dev_err(&client->dev, "bsl: cmd 0x%02x nacked: 0x%02x\n",
+			cmd, ack);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/*
+ * Commands that take time (erase, verify) answer only once done, so
+ * poll until a complete response packet shows up.
+ */
+static int tevs_bsl_recv(struct i2c_client *client, u8 rsp, u8 *core,
+			 size_t len)
+{
+	unsigned long timeout = jiffies +
+		msecs_to_jiffies(TEVS_BSL_RESPONSE_TIMEOUT_MS);
+	size_t size = len + TEVS_BSL_PACKET_OVERHEAD - 1;
+	u8 *pkt;
+	int ret;
+
+	pkt = kmalloc(size, GFP_KERNEL);
+	if (pkt == NULL)
+		return -ENOMEM;
+
+	for (;;) {
+		ret = i2c_master_recv(client, pkt, size);
+		if (ret == size && pkt[0] == TEVS_BSL_RESPONSE_HEADER)
+			break;
+		if (time_after(jiffies, timeout)) {
+			dev_err(&client->dev, "bsl: response 0x%02x timeout\n",
+				rsp);
+			ret = -ETIMEDOUT;
+			goto out;
+		}
+		usleep_range(1000, 2000);
+	}
+
+	if (get_unaligned_le16(&pkt[1]) != len || pkt[3] != rsp ||
+	    get_unaligned_le32(&pkt[3 + len]) !=
+		    tevs_bsl_crc32(TEVS_BSL_CRC32_INIT, &pkt[3], len)) {
+		dev_err(&client->dev, "bsl: bad response to 0x%02x\n", rsp);
+		ret = -EIO;
+		goto out;
+	}
+
+	memcpy(core, &pkt[3], len);
+	ret = 0;
+
+out:
+	kfree(pkt);
+	return ret;
+}
+
+static int tevs_bsl_status(struct i2c_client *client, u8 cmd)
+{
+	u8 rsp[2];
+	int ret;
+
+	ret = tevs_bsl_recv(client, TEVS_BSL_RSP_MESSAGE, rsp, sizeof(rsp));
+	if (ret)
+		return ret;
+
+	if (rsp[1] != 0) {
+		dev_err(&client->dev, "bsl: cmd 0x%02x failed: status 0x%02x\n",
+			cmd, rsp[1]);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int tevs_bsl_cmd_status(struct i2c_client *client, u8 cmd,
+			       const u8 *data, size_t len)
+{
+	int ret;
+
+	ret = tevs_bsl_send(client, cmd, data, len, 0);
+	if (ret)
+		return ret;
+
+	return tevs_bsl_status(client, cmd);
+}
+
+int tevs_bsl_connect(struct i2c_client *client)
+{
+	return tevs_bsl_send(client, TEVS_BSL_CMD_CONNECTION, NULL, 0, 0);
+}
+
+int tevs_bsl_start_app(struct i2c_client *client)
+{
+	return tevs_bsl_send(client, TEVS_BSL_CMD_START_APP, NULL, 0, 0);
+}
+
+int tevs_bsl_get_buffer_size(struct i2c_client *client, u16 *size)
+{
+	u8 info[TEVS_BSL_DEVICE_INFO_LEN];
+	int ret;
+
+	ret = tevs_bsl_send(client, TEVS_BSL_CMD_GET_DEVICE_INFO, NULL, 0, 0);
+	if (ret)
+		return ret;
+
+	ret = tevs_bsl_recv(client, TEVS_BSL_RSP_DEVICE_INFO, info,
+			    sizeof(info));
+	if (ret)
+		return ret;
+
+	*size = get_unaligned_le16(&info[TEVS_BSL_DEVICE_INFO_BUF_SIZE]);
+	return 0;
+}
+
+int tevs_bsl_unlock(struct i2c_client *client, const u8 *password)
+{
+	return tevs_bsl_cmd_status(client, TEVS_BSL_CMD_UNLOCK, password,
+				   TEVS_BSL_PASSWORD_LEN);
+}
+
+int tevs_bsl_mass_erase(struct i2c_client *client)
+{
+	return tevs_bsl_cmd_status(client, TEVS_BSL_CMD_MASS_ERASE, NULL, 0);
+}
+
+/* len is padded with 0xFF up to TEVS_BSL_PROGRAM_ALIGN */
+int tevs_bsl_program(struct i2c_client *client, u32 addr,
+		     const u8 *data, size_t len)
+{
+	size_t pad = ALIGN(len, TEVS_BSL_PROGRAM_ALIGN) - len;
+	u8 *buf;
+	int ret;
+
+	buf = kmalloc(4 + len, GFP_KERNEL);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	put_unaligned_le32(addr, buf);
+	memcpy(&buf[4], data, len);
+	ret = tevs_bsl_send(client, TEVS_BSL_CMD_PROGRAM_DATA, buf, 4 + len,
+			    pad);
+	kfree(buf);
+	if (ret)
+		return ret;
+
+	return tevs_bsl_status(client, TEVS_BSL_CMD_PROGRAM_DATA);
+}
+
+int tevs_bsl_verify(struct i2c_client *client, u32 addr, u32 len, u32 *crc)
+{
+	u8 data[8];
+	u8 rsp[5];
+	int ret;
+
+	if (len < TEVS_BSL_VERIFY_MIN_LEN)
+		return -EINVAL;
+
+	put_unaligned_le32(addr, &data[0]);
+	put_unaligned_le32(len, &data[4]);
+	ret = tevs_bsl_send(client, TEVS_BSL_CMD_VERIFY, data, sizeof(data),
+			    0);
+	if (ret)
+		return ret;
+
+	ret = tevs_bsl_recv(client, TEVS_BSL_RSP_VERIFY, rsp, sizeof(rsp));
+	if (ret)
+		return ret;
+
+	*crc = get_unaligned_le32(&rsp[1]);
+	return 0;
+}
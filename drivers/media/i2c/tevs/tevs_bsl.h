@@ -0,0 +1,43 @@
+#ifndef __TEVS_BSL_H__
+#define __TEVS_BSL_H__
+
+#include <linux/crc32.h>
+#include <linux/i2c.h>
+
+/*
+ * Host side of the TEVS MCU bootloader (BSL) protocol over I2C.
+ *
+ * Every command is framed as 0x80, length (LE16), command, data and a
+ * CRC32 (LE) of command + data. The bootloader answers each packet with
+ * an ACK byte and, for some commands, a response packet framed the same
+ * way with a 0x08 header.
+ */
+
+#define TEVS_BSL_PASSWORD_LEN		(32)
+/* header, length, command and CRC around the data of each packet */
+#define TEVS_BSL_PACKET_OVERHEAD	(8)
+/* program data carries a 4 byte address ahead of the payload */
+#define TEVS_BSL_PROGRAM_OVERHEAD	(TEVS_BSL_PACKET_OVERHEAD + 4)
+/* program data length must be a multiple of this */
+#define TEVS_BSL_PROGRAM_ALIGN		(8)
+/* standalone verification needs at least this many bytes */
+#define TEVS_BSL_VERIFY_MIN_LEN		(1024)
+
+static inline u32 tevs_bsl_crc32(u32 crc, const u8 *data, size_t len)
+{
+	/* reflected CRC32, no final inversion */
+	return crc32_le(crc, data, len);
+}
+
+#define TEVS_BSL_CRC32_INIT		(0xFFFFFFFF)
+
+int tevs_bsl_connect(struct i2c_client *client);
+int tevs_bsl_start_app(struct i2c_client *client);
+int tevs_bsl_get_buffer_size(struct i2c_client *client, u16 *size);
+int tevs_bsl_unlock(struct i2c_client *client, const u8 *password);
+int tevs_bsl_mass_erase(struct i2c_client *client);
+int tevs_bsl_program(struct i2c_client *client, u32 addr,
+		     const u8 *data, size_t len);
+int tevs_bsl_verify(struct i2c_client *client, u32 addr, u32 len, u32 *crc);
+
+#endif //__TEVS_BSL_H__
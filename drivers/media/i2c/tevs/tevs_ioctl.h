@@ -0,0 +1,40 @@
+#ifndef __TEVS_IOCTL_H__
+#define __TEVS_IOCTL_H__
+
+#include <linux/types.h>
+#include <linux/videodev2.h>
+
+/*
+ * Raw access to the image sensor behind the TEVS ISP, through the
+ * HOST_COMMAND_ISP_CTRL_I2C_ADDR/I2C_DATA passthrough window.
+ */
+
+#define TEVS_SENSOR_REG_WRITE		(1U << 0)
+
+struct tevs_sensor_reg_op {
+	__u16 reg;
+	__u16 val;	/* written value, or read result */
+	__u16 flags;	/* TEVS_SENSOR_REG_WRITE for a write, 0 for a read */
+	__u16 reserved;
+};
+
+#define TEVS_SENSOR_REG_BATCH_MAX	(128)
+
+struct tevs_sensor_reg_batch {
+	__u32 count;
+	__u32 reserved;
+	struct tevs_sensor_reg_op ops[TEVS_SENSOR_REG_BATCH_MAX];
+};
+
+/* Executes ops[0..count-1] in order, read results are returned in val */
+#define VIDIOC_TEVS_SENSOR_REG_BATCH \
+	_IOWR('V', BASE_VIDIOC_PRIVATE + 1, struct tevs_sensor_reg_batch)
+
+#ifdef __KERNEL__
+struct v4l2_subdev;
+
+int tevs_sensor_reg_batch(struct v4l2_subdev *sd,
+			  struct tevs_sensor_reg_op *ops, unsigned int count);
+#endif
+
+#endif //__TEVS_IOCTL_H__
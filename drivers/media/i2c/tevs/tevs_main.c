@@ -1,11 +1,24 @@
+#include <linux/debugfs.h>
+#include <linux/firmware.h>
+#include <linux/kfifo.h>
+#include <linux/kthread.h>
 #include <linux/module.h>
+#include <linux/compat.h>
+#include <linux/sched/task.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/of_gpio.h>
+#include <linux/workqueue.h>
 
 #include <media/tegra-v4l2-camera.h>
 #include <media/camera_common.h>
+#include <media/v4l2-event.h>
 #include "tevs_tbls.h"
+#include "tevs_ioctl.h"
+#include "tevs_bsl.h"
+#include "../tn_otp/tn_otp.h"
 
 #define DRIVER_NAME "tevs"
 
@@ -177,6 +190,10 @@
 #define TEVS_AE_MANUAL_EXP_TIME_MAX 			HOST_COMMAND_ISP_CTRL_EXP_TIME_MAX_MSB
 #define TEVS_AE_MANUAL_EXP_TIME_MIN 			HOST_COMMAND_ISP_CTRL_EXP_TIME_MIN_MSB
 #define TEVS_AE_MANUAL_EXP_TIME_MASK 			(0xFFFFFFFF)
+#define TEVS_AE_EXP_TIME_UPPER 				HOST_COMMAND_ISP_CTRL_PREVIEW_EXP_TIME_UPPER_MSB
+#define TEVS_AE_EXP_TIME_UPPER_MAX 			HOST_COMMAND_ISP_CTRL_PREVIEW_EXP_TIME_MAX_MSB
+#define TEVS_AE_EXP_TIME_UPPER_MIN 			HOST_COMMAND_ISP_CTRL_EXP_TIME_MIN_MSB
+#define TEVS_AE_EXP_TIME_UPPER_MASK 			(0xFFFFFFFF)
 #define TEVS_AE_MANUAL_GAIN 					HOST_COMMAND_ISP_CTRL_EXP_GAIN
 #define TEVS_AE_MANUAL_GAIN_MAX 				HOST_COMMAND_ISP_CTRL_EXP_GAIN_MAX
 #define TEVS_AE_MANUAL_GAIN_MIN 				HOST_COMMAND_ISP_CTRL_EXP_GAIN_MIN
@@ -205,6 +222,10 @@
 #define TEVS_AWB_MANUAL_TEMP_MAX 				HOST_COMMAND_ISP_CTRL_AWB_TEMP_MAX
 #define TEVS_AWB_MANUAL_TEMP_MIN 				HOST_COMMAND_ISP_CTRL_AWB_TEMP_MIN
 #define TEVS_AWB_MANUAL_TEMP_MASK 				(0xFFFF)
+#define TEVS_DENOISE 							HOST_COMMAND_ISP_CTRL_DENOISE
+#define TEVS_DENOISE_MAX 						HOST_COMMAND_ISP_CTRL_DENOISE_MAX
+#define TEVS_DENOISE_MIN 						HOST_COMMAND_ISP_CTRL_DENOISE_MIN
+#define TEVS_DENOISE_MASK 						(0xFFFF)
 #define TEVS_SHARPEN 							HOST_COMMAND_ISP_CTRL_SHARPEN
 #define TEVS_SHARPEN_MAX 						HOST_COMMAND_ISP_CTRL_SHARPEN_MAX
 #define TEVS_SHARPEN_MIN 						HOST_COMMAND_ISP_CTRL_SHARPEN_MIN
@@ -243,55 +264,269 @@
 #define TEVS_DZ_CT_MIN 							HOST_COMMAND_ISP_CTRL_CT_MIN
 
 #define V4L2_CID_TEVS_BSL_MODE            (V4L2_CID_USER_BASE + 44)
+#define V4L2_CID_TEVS_EXP_TIME_UPPER      (V4L2_CID_USER_BASE + 45)
+#define V4L2_CID_TEVS_THROUGHPUT          (V4L2_CID_USER_BASE + 46)
+#define V4L2_CID_TEVS_EFFECTIVE_FPS       (V4L2_CID_USER_BASE + 47)
+#define V4L2_CID_TEVS_CURRENT_EXPOSURE    (V4L2_CID_USER_BASE + 48)
+#define V4L2_CID_TEVS_CURRENT_GAIN        (V4L2_CID_USER_BASE + 49)
+#define V4L2_CID_TEVS_AE_SEED             (V4L2_CID_USER_BASE + 50)
+/* u16[3]: centre x, centre y, zoom factor */
+#define V4L2_CID_TEVS_DZ_ROI              (V4L2_CID_USER_BASE + 51)
+#define TEVS_DZ_ROI_X                     (0)
+#define TEVS_DZ_ROI_Y                     (1)
+#define TEVS_DZ_ROI_ZOOM                  (2)
+#define TEVS_DZ_ROI_ELEMS                 (3)
+#define V4L2_CID_TEVS_DENOISE             (V4L2_CID_USER_BASE + 52)
+#define V4L2_CID_TEVS_FW_UPDATE           (V4L2_CID_USER_BASE + 53)
+/* 0..100 percent, negative errno when the last update failed */
+#define V4L2_CID_TEVS_FW_PROGRESS         (V4L2_CID_USER_BASE + 54)
+/* u32[3]: target exposure (us), target gain, duration in frames */
+#define V4L2_CID_TEVS_AE_RAMP             (V4L2_CID_USER_BASE + 55)
+#define TEVS_AE_RAMP_EXPOSURE             (0)
+#define TEVS_AE_RAMP_GAIN                 (1)
+#define TEVS_AE_RAMP_FRAMES               (2)
+#define TEVS_AE_RAMP_ELEMS                (3)
+#define TEVS_AE_RAMP_MAX_FRAMES           (600)
+/* menu of preset slots: save current state into / apply one slot */
+#define V4L2_CID_TEVS_PRESET_SAVE         (V4L2_CID_USER_BASE + 56)
+#define V4L2_CID_TEVS_PRESET_APPLY        (V4L2_CID_USER_BASE + 57)
+#define TEVS_PRESETS                      (4)
+/* frame periods a failed control flush is retried before slowing down */
+#define TEVS_CTRL_FLUSH_RETRIES           (3)
+#define TEVS_CTRL_FLUSH_RETRY_MS          (1000)
+
+#define TEVS_FW_DEFAULT_NAME              "tevs_fw.bin"
+#define TEVS_FW_FLASH_BASE                (0x00000000)
+/* MCU main flash, the largest image that can be programmed */
+#define TEVS_FW_FLASH_SIZE                (0x00040000)
+/* used when the bootloader does not report its buffer size */
+#define TEVS_FW_DEFAULT_CHUNK             (256)
+
+/*
+ * Queued once auto exposure has settled after stream-on.
+ * u.data[0..3]: exposure time (us), u.data[4..5]: gain, host endian.
+ */
+#define V4L2_EVENT_TEVS_AE_CONVERGED      (V4L2_EVENT_PRIVATE_START + 1)
+#define TEVS_AE_STABLE_PERCENT            (2)
+#define TEVS_AE_STABLE_FRAMES             (3)
+#define TEVS_AE_MONITOR_TIMEOUT_S         (5)
+
+/* AE metadata sample ring, about 2 s of samples at 120 fps */
+#define TEVS_META_FIFO_SIZE               (256)
 #define TEVS_TRIGGER_CTRL_MODE_MASK 		(0x0001)
 #define TEVS_BSL_MODE_NORMAL_IDX 		    (0U << 0)
 #define TEVS_BSL_MODE_FLASH_IDX 			(1U << 0)
 
 #define DEFAULT_HEADER_VERSION 3
 
-struct header_info {
-	u8 header_version;
-	u16 content_offset;
-	u16 sensor_type;
-	u8 sensor_fuseid[16];
-	u8 product_name[64];
-	u8 lens_id[16];
-	u16 fix_checksum;
-	u8 tn_fw_version[2];
-	u16 vendor_fw_version;
-	u16 custom_number;
-	u8 build_year;
-	u8 build_month;
-	u8 build_day;
-	u8 build_hour;
-	u8 build_minute;
-	u8 build_second;
-	u16 mipi_datarate;
-	u32 content_len;
-	u16 content_checksum;
-	u16 total_checksum;
-} __attribute__((packed));
+/* Output size limits for the ISP scaler */
+#define TEVS_OUT_MIN_WIDTH 				(64)
+#define TEVS_OUT_MIN_HEIGHT 			(64)
+#define TEVS_OUT_WIDTH_ALIGN 			(4)
+#define TEVS_OUT_HEIGHT_ALIGN 			(2)
+
+/* PREVIEW_FORMAT values */
+#define TEVS_PREVIEW_FORMAT_YUV422 		(0x50)
+#define TEVS_PREVIEW_FORMAT_YUV400 		(0x52)
+
+struct tevs_format {
+	u32 code;
+	u16 preview_format;
+	u8 bpp;
+	bool mono_only;
+};
+
+/*
+ * Output formats checked on the TEVS firmware and carried by Tegra VI,
+ * selected through set_fmt
+ */
+static const struct tevs_format tevs_formats[] = {
+	{ MEDIA_BUS_FMT_UYVY8_1X16, TEVS_PREVIEW_FORMAT_YUV422, 2, false },
+	{ MEDIA_BUS_FMT_Y8_1X8, TEVS_PREVIEW_FORMAT_YUV400, 1, true },
+};
+
+struct tevs_ae_sample {
+	u32 exposure;
+	u16 gain;
+	ktime_t stamp;
+};
+
+struct tevs_frame_meta {
+	u32 sequence;
+	u64 timestamp; /* CLOCK_MONOTONIC of the I2C read, ns */
+	u32 exposure;
+	u16 gain;
+};
+
+/*
+ * Plain register controls whose writes are coalesced: only the latest
+ * value per frame period is sent. wide controls span two registers
+ * (MSB, LSB).
+ */
+struct tevs_coalesced_ctrl {
+	u32 id;
+	u16 reg;
+	u16 mask;
+	bool wide;
+};
+
+static const struct tevs_coalesced_ctrl tevs_coalesced_ctrls[] = {
+	{ V4L2_CID_BRIGHTNESS, TEVS_BRIGHTNESS, TEVS_BRIGHTNESS_MASK },
+	{ V4L2_CID_CONTRAST, TEVS_CONTRAST, TEVS_CONTRAST_MASK },
+	{ V4L2_CID_SATURATION, TEVS_SATURATION, TEVS_SATURATION_MASK },
+	{ V4L2_CID_GAMMA, TEVS_GAMMA, TEVS_GAMMA_MASK },
+	{ V4L2_CID_EXPOSURE, TEVS_AE_MANUAL_EXP_TIME, 0xFFFF, true },
+	{ V4L2_CID_GAIN, TEVS_AE_MANUAL_GAIN, TEVS_AE_MANUAL_GAIN_MASK },
+	{ V4L2_CID_WHITE_BALANCE_TEMPERATURE, TEVS_AWB_MANUAL_TEMP,
+	  TEVS_AWB_MANUAL_TEMP_MASK },
+	{ V4L2_CID_SHARPNESS, TEVS_SHARPEN, TEVS_SHARPEN_MASK },
+	{ V4L2_CID_TEVS_DENOISE, TEVS_DENOISE, TEVS_DENOISE_MASK },
+	{ V4L2_CID_BACKLIGHT_COMPENSATION, TEVS_BACKLIGHT_COMPENSATION,
+	  TEVS_BACKLIGHT_COMPENSATION_MASK },
+	{ V4L2_CID_PAN_ABSOLUTE, TEVS_DZ_CT_X, TEVS_DZ_CT_X_MASK },
+	{ V4L2_CID_TILT_ABSOLUTE, TEVS_DZ_CT_Y, TEVS_DZ_CT_Y_MASK },
+	{ V4L2_CID_ZOOM_ABSOLUTE, TEVS_DZ_TGT_FCT, TEVS_DZ_TGT_FCT_MASK },
+};
+
+#define TEVS_COALESCED_CTRLS              ARRAY_SIZE(tevs_coalesced_ctrls)
+
+/*
+ * Controls captured by a scene preset, in the order they are applied:
+ * modes first so manual values land in the right mode.
+ */
+static const u32 tevs_preset_ctrls[] = {
+	V4L2_CID_EXPOSURE_AUTO,
+	V4L2_CID_AUTO_WHITE_BALANCE,
+	V4L2_CID_POWER_LINE_FREQUENCY,
+	V4L2_CID_TEVS_EXP_TIME_UPPER,
+	V4L2_CID_EXPOSURE,
+	V4L2_CID_GAIN,
+	V4L2_CID_WHITE_BALANCE_TEMPERATURE,
+	V4L2_CID_BRIGHTNESS,
+	V4L2_CID_CONTRAST,
+	V4L2_CID_SATURATION,
+	V4L2_CID_GAMMA,
+	V4L2_CID_SHARPNESS,
+	V4L2_CID_TEVS_DENOISE,
+	V4L2_CID_BACKLIGHT_COMPENSATION,
+};
+
+struct tevs_preset {
+	bool valid;
+	s32 vals[ARRAY_SIZE(tevs_preset_ctrls)];
+};
 
 struct tevs {
 	struct device *dev;
 	struct v4l2_subdev *v4l2_subdev;
+	struct v4l2_subdev_ops subdev_ops;
+	struct v4l2_subdev_core_ops core_ops;
+	long (*tc_ioctl)(struct v4l2_subdev *sd, unsigned int cmd, void *arg);
+#ifdef CONFIG_COMPAT
+	long (*tc_compat_ioctl32)(struct v4l2_subdev *sd, unsigned int cmd,
+				  unsigned long arg);
+#endif
+	struct v4l2_subdev_video_ops video_ops;
+	struct v4l2_subdev_pad_ops pad_ops;
+	const struct v4l2_subdev_pad_ops *tc_pad_ops;
 	struct camera_common_data	*s_data;
 	struct tegracam_device		*tc_dev;
 	struct regmap *regmap;
-	struct header_info *header_info;
+	struct tn_otp_header *header_info;
 	struct gpio_desc *reset_gpio;
 	struct gpio_desc *standby_gpio;
 
 	int data_lanes;
 	int continuous_clock;
 	int data_frequency;
+	u32 throughput; /* Mbps, 0 means no limit */
+	int frame_rate; /* requested fps, 0 means mode default */
+	u32 out_width;
+	u32 out_height;
+	const struct tevs_format *format;
+	bool mono;
+	/* live AE values, refreshed at most once per frame period */
+	struct tevs_ae_sample cur_ae;
+	struct mutex ae_lock; /* Protects cur_ae */
+	struct delayed_work ae_monitor_work;
+	struct tevs_ae_sample ae_last;
+	int ae_samples;
+	int ae_stable_frames;
+	/* single producer (meta_task), readers serialised by meta_lock */
+	struct task_struct *meta_task;
+	DECLARE_KFIFO(meta_fifo, struct tevs_frame_meta, TEVS_META_FIFO_SIZE);
+	struct mutex meta_lock;
+	int meta_users; /* open frame_meta files, protected by state_lock */
+	u32 meta_sequence;
+	u32 meta_overruns;
+	struct dentry *debugfs_dir;
+	/* window shown by debugfs sensor_regs */
+	u16 sensor_reg_base;
+	u32 sensor_reg_count;
+	/* debugfs hw_ctrl_read: read cached controls back from the ISP */
+	bool hw_ctrl_read;
+	/* AE result of the previous session, used to seed the next one */
+	bool ae_seed;
+	struct tevs_ae_sample ae_snapshot;
+	/* controls backed by the manual AE registers */
+	struct v4l2_ctrl *exposure_ctrl;
+	struct v4l2_ctrl *gain_ctrl;
+	/* digital zoom limits, read from the ISP at init */
+	s64 dz_ct_min;
+	s64 dz_ct_max;
+	s64 dz_zoom_min;
+	s64 dz_zoom_max;
+	/* MCU firmware update */
+	struct work_struct fw_work;
+	const char *fw_name;
+	u8 bsl_password[TEVS_BSL_PASSWORD_LEN];
+	int fw_progress;
+	bool fw_busy;
+	/* coalesced control writes, flushed once per frame period */
+	struct mutex ctrl_lock; /* Protects ctrl_* below */
+	struct delayed_work ctrl_flush_work;
+	unsigned long ctrl_pending;
+	s32 ctrl_vals[TEVS_COALESCED_CTRLS];
+	ktime_t ctrl_flushed;
+	int ctrl_retries;
+	/* set while a preset is applied, to batch its writes */
+	bool ctrl_batch;
+	/* set while controls are written back after a firmware update */
+	bool ctrl_restore;
+	/* set while control values are updated to what the hardware has */
+	bool ctrl_sync;
+	struct tevs_preset presets[TEVS_PRESETS];
+	/* tevs_preset_ctrls, looked up once at init */
+	struct v4l2_ctrl *preset_ctrls[ARRAY_SIZE(tevs_preset_ctrls)];
+	const char *preset_names[TEVS_PRESETS + 1];
+	/* manual exposure/gain ramp, owned by ramp_task while it runs */
+	struct task_struct *ramp_task;
+	u32 ramp_exposure[2]; /* start, target */
+	u16 ramp_gain[2];
+	u32 ramp_frames;
 	u8 selected_mode;
 	u8 selected_sensor;
 	bool hw_reset_mode;
 	bool trigger_mode;
+	bool streaming;
+	bool group_hold;
+	bool fps_pending;
 	char *sensor_name;
 
-	struct mutex lock; /* Protects formats */
+	/*
+	 * Lock order: lock -> state_lock -> ctrl_lock/ae_lock/meta_lock.
+	 * s_ctrl only takes state_lock around its state checks and
+	 * updates, never across register writes, so control writes are
+	 * not held up by stream start/stop.
+	 * Register I/O is serialised per transaction by regmap and the I2C
+	 * adapter, so polling loops never hold a lock across their sleeps.
+	 */
+	struct mutex lock; /* Control handler lock */
+	/*
+	 * Protects streaming, fw_busy, frame_rate, ramp_task and the
+	 * power/stream/bootloader transitions
+	 */
+	struct mutex state_lock;
 };
 
 static const struct regmap_config tevs_regmap_config = {
@@ -300,25 +535,6 @@ static const struct regmap_config tevs_regmap_config = {
 	.cache_type = REGCACHE_NONE,
 };
 
-// #define __ENABLE_NV_CTRL
-#ifdef __ENABLE_NV_CTRL
-static const u32 ctrl_cid_list[] = {
-	TEGRA_CAMERA_CID_SENSOR_MODE_ID,
-};
-
-static int tevs_set_group_hold(struct tegracam_device *tc_dev, bool val)
-{
-	/* TEVS does not support group hold */
-	return 0;
-}
-
-static struct tegracam_ctrl_ops tevs_nv_ctrl_ops = {
-	.numctrls = ARRAY_SIZE(ctrl_cid_list),
-	.ctrl_cid_list = ctrl_cid_list,
-	.set_group_hold = tevs_set_group_hold,
-};
-#endif
-
 struct tevs* _to_tevs_priv(struct v4l2_ctrl *ctrl)
 {
 	struct tegracam_ctrl_handler *ctrl_hdl = 
@@ -393,6 +609,179 @@ int tevs_i2c_write_16b(struct tevs *tevs, u16 reg, u16 val)
 	return 0;
 }
 
+/*
+ * Write several 16-bit registers in one i2c_transfer(): the messages are
+ * joined by repeated starts, so nothing else gets on the bus between
+ * them. The ISP still takes each message as a separate register write.
+ */
+int tevs_i2c_write_16b_burst(struct tevs *tevs, const u16 *regs,
+			     const u16 *vals, int count)
+{
+	struct i2c_client *client = tevs->tc_dev->client;
+	struct i2c_msg *msgs;
+	u8 *data;
+	int i, ret;
+
+	msgs = kcalloc(count, sizeof(*msgs), GFP_KERNEL);
+	data = kcalloc(count, 4, GFP_KERNEL);
+	if (msgs == NULL || data == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < count; i++) {
+		data[i * 4 + 0] = regs[i] >> 8;
+		data[i * 4 + 1] = regs[i] & 0xFF;
+		data[i * 4 + 2] = vals[i] >> 8;
+		data[i * 4 + 3] = vals[i] & 0xFF;
+		msgs[i].addr = client->addr;
+		msgs[i].flags = 0;
+		msgs[i].len = 4;
+		msgs[i].buf = &data[i * 4];
+	}
+
+	ret = i2c_transfer(client->adapter, msgs, count);
+	if (ret < 0) {
+		dev_err(tevs->dev,
+			"Failed to write %d registers from 0x%x: ret=%d\n",
+			count, regs[0], ret);
+		goto out;
+	}
+	ret = (ret == count) ? 0 : -EIO;
+
+out:
+	kfree(data);
+	kfree(msgs);
+	return ret;
+}
+
+/*
+ * Sensor registers are reached by writing the sensor address to I2C_ADDR
+ * and then writing or reading I2C_DATA, at most 3 messages per
+ * operation. The ISP fetches the sensor register after the I2C_ADDR
+ * write and has no flag that says when I2C_DATA holds it, so a read
+ * ends the i2c_transfer() after its address write and waits
+ * TEVS_SENSOR_REG_READ_US before reading. Writes in between go out
+ * together.
+ */
+#define TEVS_SENSOR_REG_READ_US		(1000)
+
+static int tevs_sensor_reg_send(struct tevs *tevs, struct i2c_msg *msgs,
+				int num)
+{
+	struct i2c_client *client = tevs->tc_dev->client;
+	int ret;
+
+	if (num == 0)
+		return 0;
+
+	ret = i2c_transfer(client->adapter, msgs, num);
+	if (ret < 0) {
+		dev_err(tevs->dev, "sensor register batch failed: ret=%d\n",
+			ret);
+		return ret;
+	}
+
+	return (ret == num) ? 0 : -EIO;
+}
+
+static int tevs_sensor_reg_xfer(struct tevs *tevs,
+				struct tevs_sensor_reg_op *ops,
+				unsigned int count)
+{
+	struct i2c_client *client = tevs->tc_dev->client;
+	struct i2c_msg *msgs, *msg, *start;
+	u8 *data, *d;
+	unsigned int i;
+	int ret;
+
+	msgs = kcalloc(count * 3, sizeof(*msgs), GFP_KERNEL);
+	data = kcalloc(count, 10, GFP_KERNEL);
+	if (msgs == NULL || data == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	msg = start = msgs;
+	for (i = 0; i < count; i++) {
+		d = &data[i * 10];
+		d[0] = HOST_COMMAND_ISP_CTRL_I2C_ADDR >> 8;
+		d[1] = HOST_COMMAND_ISP_CTRL_I2C_ADDR & 0xFF;
+		d[2] = ops[i].reg >> 8;
+		d[3] = ops[i].reg & 0xFF;
+		d[4] = HOST_COMMAND_ISP_CTRL_I2C_DATA >> 8;
+		d[5] = HOST_COMMAND_ISP_CTRL_I2C_DATA & 0xFF;
+		d[6] = ops[i].val >> 8;
+		d[7] = ops[i].val & 0xFF;
+
+		msg->addr = client->addr;
+		msg->len = 4;
+		msg->buf = &d[0];
+		msg++;
+		if (!(ops[i].flags & TEVS_SENSOR_REG_WRITE)) {
+			ret = tevs_sensor_reg_send(tevs, start, msg - start);
+			if (ret)
+				goto out;
+			start = msg;
+			usleep_range(TEVS_SENSOR_REG_READ_US,
+				     TEVS_SENSOR_REG_READ_US + 500);
+		}
+		msg->addr = client->addr;
+		if (ops[i].flags & TEVS_SENSOR_REG_WRITE) {
+			msg->len = 4;
+			msg->buf = &d[4];
+			msg++;
+		} else {
+			msg->len = 2;
+			msg->buf = &d[4];
+			msg++;
+			msg->addr = client->addr;
+			msg->flags = I2C_M_RD;
+			msg->len = 2;
+			msg->buf = &d[8];
+			msg++;
+		}
+	}
+
+	ret = tevs_sensor_reg_send(tevs, start, msg - start);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < count; i++) {
+		if (!(ops[i].flags & TEVS_SENSOR_REG_WRITE))
+			ops[i].val = (data[i * 10 + 8] << 8) | data[i * 10 + 9];
+	}
+
+out:
+	kfree(data);
+	kfree(msgs);
+	return ret;
+}
+
+int tevs_sensor_reg_batch(struct v4l2_subdev *sd,
+			  struct tevs_sensor_reg_op *ops, unsigned int count)
+{
+	struct camera_common_data *s_data = to_camera_common_data(sd->dev);
+	struct tevs *tevs = (struct tevs *)s_data->priv;
+	unsigned int n;
+	int ret;
+
+	if (READ_ONCE(tevs->fw_busy))
+		return -EBUSY;
+
+	while (count) {
+		n = min_t(unsigned int, count, TEVS_SENSOR_REG_BATCH_MAX);
+		ret = tevs_sensor_reg_xfer(tevs, ops, n);
+		if (ret)
+			return ret;
+		ops += n;
+		count -= n;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(tevs_sensor_reg_batch);
+
 int tevs_enable_trigger_mode(struct tevs *tevs, int enable)
 {
 	int ret = 0;
@@ -440,7 +829,8 @@ int tevs_check_version(struct tevs *tevs)
 int tevs_load_header_info(struct tevs *tevs)
 {
 	struct device *dev = tevs->dev;
-	struct header_info *header = tevs->header_info;
+	struct tn_otp_header *header = tevs->header_info;
+	u8 raw[TN_OTP_HEADER_MAX_LEN];
 	u8 header_ver;
 	int ret = 0;
 
@@ -452,9 +842,15 @@ int tevs_load_header_info(struct tevs *tevs)
 	}
 
 	if (header_ver == DEFAULT_HEADER_VERSION) {
-		tevs_i2c_read(tevs, HOST_COMMAND_ISP_BOOTDATA_1,
-				(u8*)header,
-				sizeof(struct header_info));
+		ret = tevs_i2c_read(tevs, HOST_COMMAND_ISP_BOOTDATA_1, raw,
+				    tn_otp_header_len(header_ver));
+		if (ret < 0)
+			return ret;
+
+		ret = tn_otp_parse_header(dev, raw,
+					  tn_otp_header_len(header_ver), header);
+		if (ret < 0)
+			return ret;
 
 		dev_info(
 			dev,
@@ -487,10 +883,13 @@ int tevs_init_setting(struct tevs *tevs)
 
 	ret += tevs_i2c_write_16b(tevs,
 				HOST_COMMAND_ISP_CTRL_PREVIEW_FORMAT,
-				0x50);
+				tevs->format->preview_format);
 	ret += tevs_i2c_write_16b(tevs,
 				HOST_COMMAND_ISP_CTRL_PREVIEW_HINF_CTRL,
 				0x10 | (tevs->continuous_clock << 5) | (tevs->data_lanes));
+	ret += tevs_i2c_write_16b(tevs,
+				HOST_COMMAND_ISP_CTRL_PREVIEW_THROUGHPUT,
+				tevs->throughput);
 	return ret;
 }
 
@@ -561,6 +960,27 @@ static int tevs_check_boot_state(struct tevs *tevs)
 	return ret;
 }
 
+/* Link setup the ISP application needs each time it (re)starts */
+static int tevs_boot_setting(struct tevs *tevs)
+{
+	int ret;
+
+	ret = tevs_i2c_write_16b(tevs,
+				HOST_COMMAND_ISP_CTRL_MIPI_FREQ,
+				tevs->data_frequency);
+	msleep(250);
+	if (tevs_check_boot_state(tevs) != 0) {
+		dev_err(tevs->dev, "check tevs bootup status failed\n");
+		return -EINVAL;
+	}
+	if (ret < 0) {
+		dev_err(tevs->dev, "set mipi frequency failed\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static int tevs_power_on(struct camera_common_data *s_data)
 {
 	struct tegracam_device *tc_dev = to_tegracam_device(s_data);
@@ -569,12 +989,20 @@ static int tevs_power_on(struct camera_common_data *s_data)
 
 	dev_dbg(tevs->dev, "%s()\n", __func__);
 
+	mutex_lock(&tevs->state_lock);
+	if (tevs->fw_busy) {
+		ret = -EBUSY;
+		goto out;
+	}
+
 	gpiod_set_value_cansleep(tevs->reset_gpio, 1);
 	msleep(250);
 
 	ret = tevs_check_boot_state(tevs);
 	if(ret != 0)
-		return ret;
+		goto out;
+
+	s_data->power->state = SWITCH_ON;
 
 	if((tevs->hw_reset_mode | tevs->trigger_mode)) {
 		ret = tevs_init_setting(tevs);
@@ -582,6 +1010,8 @@ static int tevs_power_on(struct camera_common_data *s_data)
 			dev_err(tevs->dev, "init setting failed\n");
 	}
 
+out:
+	mutex_unlock(&tevs->state_lock);
 	return ret;
 }
 
@@ -589,13 +1019,21 @@ static int tevs_power_off(struct camera_common_data *s_data)
 {
 	struct tegracam_device *tc_dev = to_tegracam_device(s_data);
 	struct tevs *tevs = (struct tevs*)tc_dev->priv;
+	int ret = 0;
 	dev_dbg(tevs->dev, "%s()\n", __func__);
 
-	if(tevs->hw_reset_mode) {
-		gpiod_set_value_cansleep(tevs->reset_gpio, 0);
+	mutex_lock(&tevs->state_lock);
+	if (tevs->fw_busy) {
+		ret = -EBUSY;
+	} else {
+		if(tevs->hw_reset_mode) {
+			gpiod_set_value_cansleep(tevs->reset_gpio, 0);
+		}
+		s_data->power->state = SWITCH_OFF;
 	}
+	mutex_unlock(&tevs->state_lock);
 
-	return 0;
+	return ret;
 }
 
 static int tevs_power_put(struct tegracam_device *tc_dev)
@@ -690,165 +1128,1173 @@ static struct camera_common_pdata *tevs_parse_dt(
 	return board_priv_pdata;
 }
 
-static int tevs_set_mode(struct tegracam_device *tc_dev)
+/*
+ * The ISP scales the sensor mode to any PREVIEW_WIDTH/PREVIEW_HEIGHT, so
+ * pick the smallest mode that covers the requested output size. An exact
+ * table match is always the smallest such mode.
+ */
+static int tevs_find_mode(struct tevs *tevs, u32 width, u32 height)
 {
-	struct camera_common_data *s_data = tc_dev->s_data;
-	struct tevs *tevs = tc_dev->priv;
-	int i;
-	dev_dbg(tc_dev->dev,
-		"%s() , {%d}, fmt_width=%d, fmt_height=%d\n",
-		__func__,
-		s_data->mode, 
-		tc_dev->s_data->fmt_width,
-		tc_dev->s_data->fmt_height);
+	const struct sensor_info *info = &tevs_sensor_table[tevs->selected_sensor];
+	u64 area, best_area = U64_MAX;
+	int i, best = info->res_list_size - 1;
 
-	for(i = 0 ; i < tevs_sensor_table[tevs->selected_sensor].res_list_size ; i++)
+	for(i = 0 ; i < info->res_list_size ; i++)
 	{
-		if (tc_dev->s_data->fmt_width == tevs_sensor_table[tevs->selected_sensor].frmfmt[i].size.width &&
-				tc_dev->s_data->fmt_height == tevs_sensor_table[tevs->selected_sensor].frmfmt[i].size.height)
-			break;
+		if (info->frmfmt[i].size.width < width ||
+				info->frmfmt[i].size.height < height)
+			continue;
+
+		area = (u64)info->frmfmt[i].size.width * info->frmfmt[i].size.height;
+		if (area < best_area) {
+			best_area = area;
+			best = i;
+		}
 	}
 
-	if (i >= tevs_sensor_table[tevs->selected_sensor].res_list_size)
-	{
-		return -EINVAL;
-	}
+	return best;
+}
 
-	tevs->selected_mode = i;
+static void tevs_clamp_out_size(struct tevs *tevs, u32 *width, u32 *height)
+{
+	const struct sensor_info *info = &tevs_sensor_table[tevs->selected_sensor];
+	u32 max_width = 0, max_height = 0;
+	int i;
 
-	return 0;
+	for(i = 0 ; i < info->res_list_size ; i++) {
+		max_width = max_t(u32, max_width, info->frmfmt[i].size.width);
+		max_height = max_t(u32, max_height, info->frmfmt[i].size.height);
+	}
+
+	*width = round_down(clamp_t(u32, *width, TEVS_OUT_MIN_WIDTH, max_width),
+			    TEVS_OUT_WIDTH_ALIGN);
+	*height = round_down(clamp_t(u32, *height, TEVS_OUT_MIN_HEIGHT, max_height),
+			     TEVS_OUT_HEIGHT_ALIGN);
 }
 
-static int tevs_start_streaming(struct tegracam_device *tc_dev)
+static int tevs_set_mode(struct tegracam_device *tc_dev)
 {
+	struct camera_common_data *s_data = tc_dev->s_data;
 	struct tevs *tevs = tc_dev->priv;
-	int ret = 0;
-	dev_dbg(tc_dev->dev, "%s()\n", __func__);
+	int i;
 
-	if (tevs->selected_mode >=
-	    tevs_sensor_table[tevs->selected_sensor].res_list_size)
-		return -EINVAL;
+	/* tegracam holds the table mode, out_width/out_height the scaler size */
+	i = tevs_find_mode(tevs, tevs->out_width, tevs->out_height);
+	dev_dbg(tc_dev->dev,
+		"%s() , {%d}, mode %d, out_width=%d, out_height=%d\n",
+		__func__,
+		s_data->mode,
+		i,
+		tevs->out_width,
+		tevs->out_height);
 
-	if(!(tevs->hw_reset_mode | tevs->trigger_mode))
-			ret = tevs_standby(tevs, 0);
-	if (ret == 0) {
-		int fps = *tevs_sensor_table[tevs->selected_sensor]
-				  .frmfmt[tevs->selected_mode]
-				  .framerates;
-		dev_dbg(tc_dev->dev, "%s() width=%d, height=%d, mode=%d\n",
-			__func__,
-			tevs_sensor_table[tevs->selected_sensor]
-				.frmfmt[tevs->selected_mode]
-				.size.width,
-			tevs_sensor_table[tevs->selected_sensor]
-				.frmfmt[tevs->selected_mode]
-				.size.height,
-			tevs_sensor_table[tevs->selected_sensor]
-				.frmfmt[tevs->selected_mode]
-				.mode);
-		tevs_i2c_write_16b(
-			tevs,
-			HOST_COMMAND_ISP_CTRL_PREVIEW_SENSOR_MODE,
-			tevs_sensor_table[tevs->selected_sensor]
-				.frmfmt[tevs->selected_mode]
-				.mode);
-		tevs_i2c_write_16b(
-			tevs,
-			HOST_COMMAND_ISP_CTRL_PREVIEW_WIDTH,
-			tevs_sensor_table[tevs->selected_sensor]
-				.frmfmt[tevs->selected_mode]
-				.size.width);
-		tevs_i2c_write_16b(
-			tevs,
-			HOST_COMMAND_ISP_CTRL_PREVIEW_HEIGHT,
-			tevs_sensor_table[tevs->selected_sensor]
-				.frmfmt[tevs->selected_mode]
-				.size.height);
-		tevs_i2c_write_16b(
-			tevs,
-			HOST_COMMAND_ISP_CTRL_PREVIEW_MAX_FPS, fps);
-	}
+	tevs->selected_mode = i;
 
-	return ret;
+	return 0;
 }
 
-static int tevs_stop_streaming(struct tegracam_device *tc_dev)
+static int tevs_bytes_per_pixel(struct tevs *tevs)
 {
-	struct tevs *tevs = tc_dev->priv;
-	int ret = 0;
+	return tevs->format->bpp;
+}
 
-	if(!(tevs->hw_reset_mode | tevs->trigger_mode))
-			ret = tevs_standby(tevs, 1);
-	return ret;
+static u32 tevs_link_capacity(struct tevs *tevs)
+{
+	return tevs->data_lanes * tevs->data_frequency;
 }
 
-static inline int tevs_read_reg(struct camera_common_data *s_data,
-	u16 addr, u8 *val)
+/*
+ * Highest frame rate the throughput limit can carry for the given frame
+ * size, or 0 when the limit cannot carry a single frame per second.
+ */
+static int tevs_throughput_fps(struct tevs *tevs, u32 throughput,
+			       u32 width, u32 height)
 {
-	int err = 0;
-	u32 reg_val = 0;
+	u64 frame_bits = (u64)width * height * tevs_bytes_per_pixel(tevs) * 8;
 
-	err = regmap_read(s_data->regmap, addr, &reg_val);
-	*val = reg_val & 0xff;
+	if (frame_bits == 0)
+		return 0;
 
-	return err;
+	return div64_u64((u64)throughput * 1000000, frame_bits);
 }
 
-static inline int tevs_write_reg(struct camera_common_data *s_data,
-	u16 addr, u8 val)
+static int tevs_validate_throughput(struct tevs *tevs, u32 throughput)
 {
-	int err = 0;
+	if (throughput == 0)
+		return 0;
 
-	err = regmap_write(s_data->regmap, addr, val);
-	if (err)
-		dev_err(s_data->dev, "%s: i2c write failed, 0x%x = %x",
-			__func__, addr, val);
+	if (throughput > tevs_link_capacity(tevs))
+		return -EINVAL;
 
-	return err;
-}
+	if (tevs_throughput_fps(tevs, throughput, tevs->out_width,
+				tevs->out_height) < 1) {
+		dev_err(tevs->dev,
+			"throughput %u Mbps is too low for %ux%u\n",
+			throughput, tevs->out_width, tevs->out_height);
+		return -EINVAL;
+	}
 
-static struct camera_common_sensor_ops tevs_common_ops = {
-	.numfrmfmts = ARRAY_SIZE(sensor_frmfmt),
-	.frmfmt_table = sensor_frmfmt,
-	.power_on = tevs_power_on,
-	.power_off = tevs_power_off,
-	.write_reg = tevs_write_reg,
-	.read_reg = tevs_read_reg,
-	.parse_dt = tevs_parse_dt,
-	.power_get = tevs_power_get,
-	.power_put = tevs_power_put,
-	.set_mode = tevs_set_mode,
-	.start_streaming = tevs_start_streaming,
-	.stop_streaming = tevs_stop_streaming,
-};
+	return 0;
+}
 
-/* -----------------------------------------------------------------------------
- * V4L2 Controls
+/*
+ * Frame rate the ISP is asked for: the rate requested through
+ * TEGRA_CAMERA_CID_FRAME_RATE (if any) limited to the mode maximum and
+ * to what the throughput limit can carry.
  */
-
-static int tevs_set_brightness(struct tevs *tevs, s32 value)
+static int tevs_stream_fps(struct tevs *tevs)
 {
-	// Format is u3.12
-	return tevs_i2c_write_16b(tevs, TEVS_BRIGHTNESS,
-				    value & TEVS_BRIGHTNESS_MASK);
-}
+	const struct camera_common_frmfmt *frmfmt =
+		&tevs_sensor_table[tevs->selected_sensor]
+			 .frmfmt[tevs->selected_mode];
+	int fps = *frmfmt->framerates;
 
-static int tevs_get_brightness(struct tevs *tevs, s32 *value)
-{
-	u16 val;
-	int ret;
-	ret = tevs_i2c_read_16b(tevs, TEVS_BRIGHTNESS,
-				  &val);
-	if (ret)
-		return ret;
+	if (tevs->frame_rate)
+		fps = min(fps, tevs->frame_rate);
 
-	*value = val & TEVS_BRIGHTNESS_MASK;
-	return 0;
+	if (tevs->throughput)
+		fps = min(fps, tevs_throughput_fps(tevs, tevs->throughput,
+						   tevs->out_width,
+						   tevs->out_height));
+
+	return fps;
 }
 
-static int tevs_get_brightness_max(struct tevs *tevs, s64 *value)
+/*
+ * CURRENT_EXP_TIME_MSB/LSB and CURRENT_EXP_GAIN are contiguous, so a
+ * single 6 byte read fetches both. The result is reused until the next
+ * frame is due, polling clients cannot flood the bus.
+ */
+static int tevs_read_current_ae(struct tevs *tevs, struct tevs_ae_sample *sample)
 {
-	u16 val;
+	ktime_t now = ktime_get();
+	s64 period_ns = NSEC_PER_SEC / max(tevs_stream_fps(tevs), 1);
+	u8 val[6] = { 0 };
+	int ret = 0;
+
+	mutex_lock(&tevs->ae_lock);
+	if (tevs->cur_ae.stamp == 0 ||
+	    ktime_to_ns(ktime_sub(now, tevs->cur_ae.stamp)) >= period_ns) {
+		ret = tevs_i2c_read(tevs,
+				    HOST_COMMAND_ISP_CTRL_CURRENT_EXP_TIME_MSB,
+				    val, sizeof(val));
+		if (ret == 0) {
+			tevs->cur_ae.exposure = be32_to_cpup((__be32 *)val);
+			tevs->cur_ae.gain = be16_to_cpup((__be16 *)&val[4]);
+			tevs->cur_ae.stamp = now;
+		}
+	}
+	if (ret == 0)
+		*sample = tevs->cur_ae;
+	mutex_unlock(&tevs->ae_lock);
+
+	return ret;
+}
+
+static void tevs_invalidate_current_ae(struct tevs *tevs)
+{
+	mutex_lock(&tevs->ae_lock);
+	tevs->cur_ae.stamp = 0;
+	mutex_unlock(&tevs->ae_lock);
+}
+
+/*
+ * After stream-on (or switching AE back to auto) the AE output is
+ * sampled once per frame. When exposure and gain have stayed within
+ * TEVS_AE_STABLE_PERCENT for TEVS_AE_STABLE_FRAMES frames, a
+ * V4L2_EVENT_TEVS_AE_CONVERGED event is queued on the subdev node.
+ */
+static void tevs_ae_monitor_work(struct work_struct *work)
+{
+	struct tevs *tevs = container_of(to_delayed_work(work), struct tevs,
+					 ae_monitor_work);
+	struct tevs_ae_sample *last = &tevs->ae_last;
+	struct tevs_ae_sample cur;
+	struct v4l2_event ev = { 0 };
+	int fps = max(tevs_stream_fps(tevs), 1);
+
+	/* Cancelled synchronously under state_lock before streaming clears */
+	if (!tevs->streaming)
+		return;
+
+	tevs->ae_samples++;
+	if (tevs_read_current_ae(tevs, &cur) == 0 && cur.stamp != last->stamp) {
+		if (last->stamp &&
+		    abs((s64)cur.exposure - last->exposure) * 100 <=
+			    (s64)last->exposure * TEVS_AE_STABLE_PERCENT &&
+		    abs((s32)cur.gain - last->gain) * 100 <=
+			    (s32)last->gain * TEVS_AE_STABLE_PERCENT)
+			tevs->ae_stable_frames++;
+		else
+			tevs->ae_stable_frames = 0;
+		*last = cur;
+	}
+
+	if (tevs->ae_stable_frames >= TEVS_AE_STABLE_FRAMES) {
+		ev.type = V4L2_EVENT_TEVS_AE_CONVERGED;
+		*(u32 *)&ev.u.data[0] = last->exposure;
+		*(u16 *)&ev.u.data[4] = last->gain;
+		v4l2_subdev_notify_event(tevs->v4l2_subdev, &ev);
+		dev_dbg(tevs->dev, "%s() AE converged: exposure %u, gain %u\n",
+			__func__, last->exposure, last->gain);
+		return;
+	}
+
+	if (tevs->ae_samples >= fps * TEVS_AE_MONITOR_TIMEOUT_S) {
+		dev_dbg(tevs->dev, "%s() AE did not converge\n", __func__);
+		return;
+	}
+
+	schedule_delayed_work(&tevs->ae_monitor_work,
+			      msecs_to_jiffies(DIV_ROUND_UP(1000, fps)));
+}
+
+static void tevs_ae_monitor_start(struct tevs *tevs)
+{
+	cancel_delayed_work_sync(&tevs->ae_monitor_work);
+	tevs->ae_samples = 0;
+	tevs->ae_stable_frames = 0;
+	tevs->ae_last.stamp = 0;
+	schedule_delayed_work(&tevs->ae_monitor_work, 0);
+}
+
+/*
+ * Samples the AE output once per frame period into meta_fifo, while
+ * streaming and only as long as frame_meta is open. The fifo has
+ * exactly one producer and the debugfs reader holds meta_lock, so
+ * kfifo_put() needs no lock. The sample itself is read over I2C under
+ * ae_lock, shared with the readback controls. Samples that find the
+ * fifo full are dropped and counted in meta_overruns.
+ */
+static int tevs_meta_thread(void *data)
+{
+	struct tevs *tevs = data;
+	struct tevs_ae_sample cur;
+	struct tevs_frame_meta meta;
+	ktime_t last_stamp = 0;
+	ktime_t next = ktime_get();
+	s64 delay_us;
+
+	while (!kthread_should_stop()) {
+		if (tevs_read_current_ae(tevs, &cur) == 0 &&
+		    cur.stamp != last_stamp) {
+			last_stamp = cur.stamp;
+			meta.sequence = tevs->meta_sequence++;
+			meta.timestamp = ktime_to_ns(cur.stamp);
+			meta.exposure = cur.exposure;
+			meta.gain = cur.gain;
+			if (!kfifo_put(&tevs->meta_fifo, meta))
+				tevs->meta_overruns++;
+		}
+
+		next = ktime_add_us(next,
+				    USEC_PER_SEC / max(tevs_stream_fps(tevs), 1));
+		delay_us = ktime_us_delta(next, ktime_get());
+		if (delay_us > 0)
+			usleep_range(delay_us, delay_us + 100);
+		else
+			next = ktime_get();
+	}
+
+	return 0;
+}
+
+static void tevs_meta_start(struct tevs *tevs)
+{
+	struct task_struct *task;
+
+	if (tevs->meta_task || tevs->meta_users == 0)
+		return;
+
+	mutex_lock(&tevs->meta_lock);
+	kfifo_reset(&tevs->meta_fifo);
+	tevs->meta_sequence = 0;
+	tevs->meta_overruns = 0;
+	mutex_unlock(&tevs->meta_lock);
+
+	task = kthread_run(tevs_meta_thread, tevs, "tevs-meta");
+	if (IS_ERR(task)) {
+		dev_warn(tevs->dev, "cannot start metadata sampling: %ld\n",
+			 PTR_ERR(task));
+		return;
+	}
+	tevs->meta_task = task;
+}
+
+static void tevs_meta_stop(struct tevs *tevs)
+{
+	if (tevs->meta_task == NULL)
+		return;
+
+	kthread_stop(tevs->meta_task);
+	tevs->meta_task = NULL;
+}
+
+static bool tevs_ae_is_auto(struct tevs *tevs)
+{
+	u16 val;
+
+	if (tevs_i2c_read_16b(tevs, TEVS_AE_CTRL_MODE, &val) != 0)
+		return false;
+
+	return (val & TEVS_AE_CTRL_MODE_MASK) == TEVS_AE_CTRL_FULL_AUTO;
+}
+
+/*
+ * Called before standby: remember where AE settled so the next stream
+ * can start from there instead of the firmware defaults.
+ */
+static void tevs_ae_snapshot(struct tevs *tevs)
+{
+	struct tevs_ae_sample cur;
+
+	if (!tevs->ae_seed || !tevs_ae_is_auto(tevs))
+		return;
+
+	tevs_invalidate_current_ae(tevs);
+	if (tevs_read_current_ae(tevs, &cur) != 0 || cur.exposure == 0)
+		return;
+
+	tevs->ae_snapshot = cur;
+	dev_dbg(tevs->dev, "%s() exposure %u, gain %u\n", __func__,
+		cur.exposure, cur.gain);
+}
+
+/*
+ * AE starts from the manual exposure/gain registers, so load the
+ * snapshot there and re-enter auto mode while the ISP is still in
+ * standby. This overwrites the values behind the EXPOSURE and GAIN
+ * controls; they are written again on the switch back to manual mode.
+ */
+static void tevs_ae_seed(struct tevs *tevs)
+{
+	__be32 exposure = cpu_to_be32(tevs->ae_snapshot.exposure);
+	int ret = 0;
+
+	if (!tevs->ae_seed || tevs->ae_snapshot.stamp == 0 ||
+	    !tevs_ae_is_auto(tevs))
+		return;
+
+	ret += tevs_i2c_write_16b(tevs, TEVS_AE_CTRL_MODE,
+				  TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN);
+	ret += tevs_i2c_write(tevs, TEVS_AE_MANUAL_EXP_TIME,
+			      (u8 *)&exposure, 4);
+	ret += tevs_i2c_write_16b(tevs, TEVS_AE_MANUAL_GAIN,
+				  tevs->ae_snapshot.gain & TEVS_AE_MANUAL_GAIN_MASK);
+	ret += tevs_i2c_write_16b(tevs, TEVS_AE_CTRL_MODE,
+				  TEVS_AE_CTRL_FULL_AUTO);
+
+	if (ret)
+		dev_warn(tevs->dev, "seeding AE failed\n");
+}
+
+/*
+ * A failed burst leaves the controls pending, the hardware still has
+ * the old values. It is retried once per frame period, then every
+ * TEVS_CTRL_FLUSH_RETRY_MS until it goes through, so the cached values
+ * do reach the hardware. Newer writes to the same controls replace the
+ * pending values in the meantime.
+ */
+static int tevs_ctrl_burst(struct tevs *tevs)
+{
+	const struct tevs_coalesced_ctrl *c;
+	u16 regs[TEVS_COALESCED_CTRLS * 2];
+	u16 vals[TEVS_COALESCED_CTRLS * 2];
+	int i, n = 0;
+	int ret = 0;
+
+	lockdep_assert_held(&tevs->ctrl_lock);
+
+	for_each_set_bit(i, &tevs->ctrl_pending, TEVS_COALESCED_CTRLS) {
+		c = &tevs_coalesced_ctrls[i];
+		if (c->wide) {
+			regs[n] = c->reg;
+			vals[n++] = (u32)tevs->ctrl_vals[i] >> 16;
+			regs[n] = c->reg + 2;
+		} else {
+			regs[n] = c->reg;
+		}
+		vals[n++] = tevs->ctrl_vals[i] & c->mask;
+	}
+	tevs->ctrl_flushed = ktime_get();
+
+	if (n)
+		ret = tevs_i2c_write_16b_burst(tevs, regs, vals, n);
+	if (ret) {
+		if (++tevs->ctrl_retries <= TEVS_CTRL_FLUSH_RETRIES) {
+			schedule_delayed_work(&tevs->ctrl_flush_work,
+				usecs_to_jiffies(USEC_PER_SEC /
+						 max(tevs_stream_fps(tevs), 1)));
+		} else {
+			if (tevs->ctrl_retries == TEVS_CTRL_FLUSH_RETRIES + 1)
+				dev_warn(tevs->dev,
+					 "flushing %d control registers failed, retrying\n",
+					 n);
+			schedule_delayed_work(&tevs->ctrl_flush_work,
+				msecs_to_jiffies(TEVS_CTRL_FLUSH_RETRY_MS));
+		}
+	} else {
+		if (tevs->ctrl_retries > TEVS_CTRL_FLUSH_RETRIES)
+			dev_info(tevs->dev, "control registers flushed\n");
+		tevs->ctrl_pending = 0;
+		tevs->ctrl_retries = 0;
+	}
+
+	return ret;
+}
+
+static void tevs_ctrl_flush_work(struct work_struct *work)
+{
+	struct tevs *tevs = container_of(to_delayed_work(work), struct tevs,
+					 ctrl_flush_work);
+
+	mutex_lock(&tevs->ctrl_lock);
+	tevs_ctrl_burst(tevs);
+	mutex_unlock(&tevs->ctrl_lock);
+}
+
+/*
+ * Records the value and makes sure a flush is scheduled no earlier than
+ * one frame period after the previous one. The control framework keeps
+ * the value as current, so the caller returns without bus traffic and
+ * reads are answered from the cache. Returns -ENOENT for controls that
+ * are not coalesced.
+ */
+static int tevs_ctrl_queue(struct tevs *tevs, u32 id, s32 val)
+{
+	s64 delay_us;
+	int i;
+
+	for (i = 0; i < TEVS_COALESCED_CTRLS; i++)
+		if (tevs_coalesced_ctrls[i].id == id)
+			break;
+	if (i == TEVS_COALESCED_CTRLS)
+		return -ENOENT;
+
+	mutex_lock(&tevs->ctrl_lock);
+	tevs->ctrl_vals[i] = val;
+	set_bit(i, &tevs->ctrl_pending);
+	if (!delayed_work_pending(&tevs->ctrl_flush_work)) {
+		delay_us = ktime_us_delta(
+			ktime_add_us(tevs->ctrl_flushed,
+				     USEC_PER_SEC / max(tevs_stream_fps(tevs), 1)),
+			ktime_get());
+		schedule_delayed_work(&tevs->ctrl_flush_work,
+				      delay_us > 0 ? usecs_to_jiffies(delay_us) : 0);
+	}
+	mutex_unlock(&tevs->ctrl_lock);
+
+	return 0;
+}
+
+/*
+ * Sends whatever is pending now, before writes that must follow it, and
+ * returns the burst's error. A failed burst is still retried later.
+ */
+static int tevs_ctrl_flush(struct tevs *tevs)
+{
+	int ret;
+
+	cancel_delayed_work_sync(&tevs->ctrl_flush_work);
+	mutex_lock(&tevs->ctrl_lock);
+	ret = tevs_ctrl_burst(tevs);
+	mutex_unlock(&tevs->ctrl_lock);
+
+	return ret;
+}
+
+/* EXP_TIME_MSB/LSB go out as one 4 byte write, the gain follows */
+static int tevs_write_exposure_gain(struct tevs *tevs, u32 exposure,
+				    u16 gain)
+{
+	__be32 val = cpu_to_be32(exposure);
+	int ret;
+
+	ret = tevs_i2c_write(tevs, TEVS_AE_MANUAL_EXP_TIME, (u8 *)&val, 4);
+	if (ret)
+		return ret;
+
+	return tevs_i2c_write_16b(tevs, TEVS_AE_MANUAL_GAIN,
+				  gain & TEVS_AE_MANUAL_GAIN_MASK);
+}
+
+/*
+ * Steps the manual exposure and gain linearly from ramp_*[0] to
+ * ramp_*[1] over ramp_frames frame periods, one step per frame, then
+ * exits. ramp_task keeps a reference, so tevs_ae_ramp_stop() can reap
+ * the thread whether it is still running or not.
+ */
+static int tevs_ae_ramp_thread(void *data)
+{
+	struct tevs *tevs = data;
+	s64 d_exp = (s64)tevs->ramp_exposure[1] - tevs->ramp_exposure[0];
+	s32 d_gain = (s32)tevs->ramp_gain[1] - tevs->ramp_gain[0];
+	ktime_t next = ktime_get();
+	s64 delay_us;
+	u32 i;
+
+	for (i = 1; i <= tevs->ramp_frames && !kthread_should_stop(); i++) {
+		if (tevs_write_exposure_gain(
+			    tevs,
+			    tevs->ramp_exposure[0] +
+				    div_s64(d_exp * i, tevs->ramp_frames),
+			    tevs->ramp_gain[0] +
+				    d_gain * (s32)i / (s32)tevs->ramp_frames)) {
+			dev_warn(tevs->dev, "AE ramp aborted at frame %u\n", i);
+			break;
+		}
+
+		next = ktime_add_us(next,
+				    USEC_PER_SEC / max(tevs_stream_fps(tevs), 1));
+		delay_us = ktime_us_delta(next, ktime_get());
+		if (delay_us > 0)
+			usleep_range(delay_us, delay_us + 100);
+		else
+			next = ktime_get();
+	}
+
+	return 0;
+}
+
+/* ramp_task changes under state_lock */
+static void __tevs_ae_ramp_stop(struct tevs *tevs)
+{
+	lockdep_assert_held(&tevs->state_lock);
+
+	if (tevs->ramp_task == NULL)
+		return;
+
+	kthread_stop(tevs->ramp_task);
+	put_task_struct(tevs->ramp_task);
+	tevs->ramp_task = NULL;
+}
+
+static void tevs_ae_ramp_stop(struct tevs *tevs)
+{
+	struct task_struct *task;
+
+	mutex_lock(&tevs->state_lock);
+	task = tevs->ramp_task;
+	tevs->ramp_task = NULL;
+	mutex_unlock(&tevs->state_lock);
+
+	if (task == NULL)
+		return;
+
+	kthread_stop(task);
+	put_task_struct(task);
+}
+
+/*
+ * The ramp ends on its target, so EXPOSURE and GAIN take the target
+ * values right away. Called with the handler lock held; ctrl_sync keeps
+ * s_ctrl from writing them (and stopping the ramp).
+ */
+static void tevs_ae_ramp_sync_ctrls(struct tevs *tevs, const u32 *ramp)
+{
+	tevs->ctrl_sync = true;
+	if (tevs->exposure_ctrl)
+		__v4l2_ctrl_s_ctrl(tevs->exposure_ctrl,
+				   ramp[TEVS_AE_RAMP_EXPOSURE]);
+	if (tevs->gain_ctrl)
+		__v4l2_ctrl_s_ctrl(tevs->gain_ctrl, ramp[TEVS_AE_RAMP_GAIN]);
+	tevs->ctrl_sync = false;
+}
+
+/*
+ * Only meaningful with manual exposure and gain: in auto mode the ISP
+ * owns both registers. Outside streaming, or for a zero length ramp,
+ * the target is written at once.
+ */
+static int tevs_ae_ramp(struct tevs *tevs, const u32 *ramp)
+{
+	struct task_struct *task;
+	__be32 exposure;
+	u16 gain;
+	int ret;
+
+	tevs_ae_ramp_stop(tevs);
+	tevs_ctrl_flush(tevs);
+
+	if (tevs_ae_is_auto(tevs))
+		return -EBUSY;
+
+	if (!READ_ONCE(tevs->streaming) || ramp[TEVS_AE_RAMP_FRAMES] == 0) {
+		ret = tevs_write_exposure_gain(tevs,
+					       ramp[TEVS_AE_RAMP_EXPOSURE],
+					       ramp[TEVS_AE_RAMP_GAIN]);
+		if (ret == 0)
+			tevs_ae_ramp_sync_ctrls(tevs, ramp);
+		return ret;
+	}
+
+	ret = tevs_i2c_read(tevs, TEVS_AE_MANUAL_EXP_TIME, (u8 *)&exposure, 4);
+	if (ret == 0)
+		ret = tevs_i2c_read_16b(tevs, TEVS_AE_MANUAL_GAIN, &gain);
+	if (ret)
+		return ret;
+
+	tevs->ramp_exposure[0] = be32_to_cpu(exposure);
+	tevs->ramp_exposure[1] = ramp[TEVS_AE_RAMP_EXPOSURE];
+	tevs->ramp_gain[0] = gain & TEVS_AE_MANUAL_GAIN_MASK;
+	tevs->ramp_gain[1] = ramp[TEVS_AE_RAMP_GAIN];
+	tevs->ramp_frames = ramp[TEVS_AE_RAMP_FRAMES];
+
+	task = kthread_create(tevs_ae_ramp_thread, tevs, "tevs-ramp");
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+	get_task_struct(task);
+	mutex_lock(&tevs->state_lock);
+	tevs->ramp_task = task;
+	mutex_unlock(&tevs->state_lock);
+	wake_up_process(task);
+	tevs_ae_ramp_sync_ctrls(tevs, ramp);
+
+	return 0;
+}
+
+static int __tevs_start_streaming(struct tegracam_device *tc_dev)
+{
+	struct tevs *tevs = tc_dev->priv;
+	int ret = 0;
+	dev_dbg(tc_dev->dev, "%s()\n", __func__);
+
+	if (tevs->selected_mode >=
+	    tevs_sensor_table[tevs->selected_sensor].res_list_size)
+		return -EINVAL;
+
+	if (tevs->fw_busy)
+		return -EBUSY;
+
+	ret = tevs_validate_throughput(tevs, tevs->throughput);
+	if (ret)
+		return ret;
+
+	tevs_ae_seed(tevs);
+	if(!(tevs->hw_reset_mode | tevs->trigger_mode))
+			ret = tevs_standby(tevs, 0);
+	if (ret == 0) {
+		int fps = tevs_stream_fps(tevs);
+
+		dev_dbg(tc_dev->dev, "%s() width=%u, height=%u, mode=%d, fps=%d\n",
+			__func__,
+			tevs->out_width,
+			tevs->out_height,
+			tevs_sensor_table[tevs->selected_sensor]
+				.frmfmt[tevs->selected_mode]
+				.mode,
+			fps);
+		tevs_i2c_write_16b(
+			tevs,
+			HOST_COMMAND_ISP_CTRL_PREVIEW_FORMAT,
+			tevs->format->preview_format);
+		tevs_i2c_write_16b(
+			tevs,
+			HOST_COMMAND_ISP_CTRL_PREVIEW_SENSOR_MODE,
+			tevs_sensor_table[tevs->selected_sensor]
+				.frmfmt[tevs->selected_mode]
+				.mode);
+		tevs_i2c_write_16b(
+			tevs,
+			HOST_COMMAND_ISP_CTRL_PREVIEW_WIDTH,
+			tevs->out_width);
+		tevs_i2c_write_16b(
+			tevs,
+			HOST_COMMAND_ISP_CTRL_PREVIEW_HEIGHT,
+			tevs->out_height);
+		tevs_i2c_write_16b(
+			tevs,
+			HOST_COMMAND_ISP_CTRL_PREVIEW_THROUGHPUT,
+			tevs->throughput);
+		tevs_i2c_write_16b(
+			tevs,
+			HOST_COMMAND_ISP_CTRL_PREVIEW_MAX_FPS, fps);
+		tevs->fps_pending = false;
+		tevs_invalidate_current_ae(tevs);
+		tevs->streaming = true;
+		tevs_ae_monitor_start(tevs);
+		tevs_meta_start(tevs);
+	}
+
+	return ret;
+}
+
+static int __tevs_stop_streaming(struct tegracam_device *tc_dev)
+{
+	struct tevs *tevs = tc_dev->priv;
+	int ret = 0;
+
+	tevs->streaming = false;
+	cancel_delayed_work_sync(&tevs->ae_monitor_work);
+	__tevs_ae_ramp_stop(tevs);
+	tevs_ctrl_flush(tevs);
+	tevs_meta_stop(tevs);
+	tevs_ae_snapshot(tevs);
+	if(!(tevs->hw_reset_mode | tevs->trigger_mode))
+			ret = tevs_standby(tevs, 1);
+	return ret;
+}
+
+/*
+ * Stream transitions poll the ISP for up to a second; they only hold
+ * state_lock, so control reads are not held up meanwhile.
+ */
+static int tevs_start_streaming(struct tegracam_device *tc_dev)
+{
+	struct tevs *tevs = tc_dev->priv;
+	int ret;
+
+	mutex_lock(&tevs->state_lock);
+	ret = __tevs_start_streaming(tc_dev);
+	mutex_unlock(&tevs->state_lock);
+
+	return ret;
+}
+
+static int tevs_stop_streaming(struct tegracam_device *tc_dev)
+{
+	struct tevs *tevs = tc_dev->priv;
+	int ret;
+
+	mutex_lock(&tevs->state_lock);
+	ret = __tevs_stop_streaming(tc_dev);
+	mutex_unlock(&tevs->state_lock);
+
+	return ret;
+}
+
+static const u32 ctrl_cid_list[] = {
+	TEGRA_CAMERA_CID_FRAME_RATE,
+	TEGRA_CAMERA_CID_SENSOR_MODE_ID,
+};
+
+static int tevs_set_frame_rate(struct tegracam_device *tc_dev, s64 val)
+{
+	struct camera_common_data *s_data = tc_dev->s_data;
+	struct tevs *tevs = tc_dev->priv;
+	u32 factor = 1;
+	int ret = 0;
+
+	if (s_data->mode_prop_idx < s_data->sensor_props.num_modes)
+		factor = s_data->sensor_props.sensor_modes[s_data->mode_prop_idx]
+				 .control_properties.framerate_factor;
+	if (factor == 0)
+		factor = 1;
+
+	tevs->frame_rate = max_t(s64, div_s64(val, factor), 1);
+	dev_dbg(tevs->dev, "%s() frame rate %d fps\n", __func__,
+		tevs->frame_rate);
+
+	mutex_lock(&tevs->state_lock);
+	/* Applied by tevs_start_streaming() when not streaming yet */
+	if (tevs->streaming) {
+		if (tevs->group_hold)
+			tevs->fps_pending = true;
+		else
+			ret = tevs_i2c_write_16b(tevs,
+					HOST_COMMAND_ISP_CTRL_PREVIEW_MAX_FPS,
+					tevs_stream_fps(tevs));
+	}
+	mutex_unlock(&tevs->state_lock);
+
+	return ret;
+}
+
+/*
+ * TEVS has no hardware group hold, so settings written while the hold
+ * is active are latched by the driver and committed on release.
+ */
+static int tevs_set_group_hold(struct tegracam_device *tc_dev, bool val)
+{
+	struct tevs *tevs = tc_dev->priv;
+	int ret = 0;
+
+	tevs->group_hold = val;
+	if (val)
+		return 0;
+
+	mutex_lock(&tevs->state_lock);
+	if (tevs->fps_pending && tevs->streaming)
+		ret = tevs_i2c_write_16b(tevs,
+					 HOST_COMMAND_ISP_CTRL_PREVIEW_MAX_FPS,
+					 tevs_stream_fps(tevs));
+	tevs->fps_pending = false;
+	mutex_unlock(&tevs->state_lock);
+
+	return ret;
+}
+
+static struct tegracam_ctrl_ops tevs_nv_ctrl_ops = {
+	.numctrls = ARRAY_SIZE(ctrl_cid_list),
+	.ctrl_cid_list = ctrl_cid_list,
+	.set_frame_rate = tevs_set_frame_rate,
+	.set_group_hold = tevs_set_group_hold,
+};
+
+/*
+ * Frame interval handling: the rates listed for the current mode in
+ * tevs_tbls.h are enumerated by the framework, the chosen one ends up
+ * in PREVIEW_MAX_FPS.
+ */
+static int tevs_current_mode(struct tevs *tevs)
+{
+	return tevs_find_mode(tevs, tevs->out_width, tevs->out_height);
+}
+
+static int tevs_g_frame_interval(struct v4l2_subdev *sd,
+				 struct v4l2_subdev_frame_interval *fi)
+{
+	struct camera_common_data *s_data = to_camera_common_data(sd->dev);
+	struct tevs *tevs = (struct tevs *)s_data->priv;
+	const struct camera_common_frmfmt *frmfmt =
+		&tevs_sensor_table[tevs->selected_sensor]
+			 .frmfmt[tevs_current_mode(tevs)];
+	int fps = *frmfmt->framerates;
+
+	mutex_lock(&tevs->state_lock);
+	if (tevs->streaming)
+		fps = tevs_stream_fps(tevs);
+	else if (tevs->frame_rate)
+		fps = min(fps, tevs->frame_rate);
+	mutex_unlock(&tevs->state_lock);
+
+	fi->interval.numerator = 1;
+	fi->interval.denominator = fps;
+
+	return 0;
+}
+
+static int tevs_s_frame_interval(struct v4l2_subdev *sd,
+				 struct v4l2_subdev_frame_interval *fi)
+{
+	struct camera_common_data *s_data = to_camera_common_data(sd->dev);
+	struct tevs *tevs = (struct tevs *)s_data->priv;
+	const struct camera_common_frmfmt *frmfmt =
+		&tevs_sensor_table[tevs->selected_sensor]
+			 .frmfmt[tevs_current_mode(tevs)];
+	int fps = frmfmt->framerates[0];
+	int req, i;
+	int ret = 0;
+
+	if (fi->interval.numerator && fi->interval.denominator) {
+		req = DIV_ROUND_CLOSEST(fi->interval.denominator,
+					fi->interval.numerator);
+		for (i = 1; i < frmfmt->num_framerates; i++) {
+			if (abs(frmfmt->framerates[i] - req) <
+			    abs(fps - req))
+				fps = frmfmt->framerates[i];
+		}
+	}
+
+	dev_dbg(tevs->dev, "%s() %u/%u -> %d fps\n", __func__,
+		fi->interval.numerator, fi->interval.denominator, fps);
+
+	fi->interval.numerator = 1;
+	fi->interval.denominator = fps;
+
+	mutex_lock(&tevs->state_lock);
+	tevs->frame_rate = fps;
+	if (tevs->streaming)
+		ret = tevs_i2c_write_16b(tevs,
+					 HOST_COMMAND_ISP_CTRL_PREVIEW_MAX_FPS,
+					 tevs_stream_fps(tevs));
+	mutex_unlock(&tevs->state_lock);
+
+	return ret;
+}
+
+static bool tevs_format_supported(struct tevs *tevs,
+				  const struct tevs_format *format)
+{
+	return !format->mono_only || tevs->mono;
+}
+
+static const struct tevs_format *tevs_find_format(struct tevs *tevs, u32 code)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(tevs_formats); i++) {
+		if (tevs_formats[i].code == code &&
+		    tevs_format_supported(tevs, &tevs_formats[i]))
+			return &tevs_formats[i];
+	}
+
+	return NULL;
+}
+
+static const struct tevs_format *tevs_default_format(struct tevs *tevs)
+{
+	/* Mono sensors carry no chroma, so Y8 by default */
+	if (tevs->mono)
+		return tevs_find_format(tevs, MEDIA_BUS_FMT_Y8_1X8);
+
+	return &tevs_formats[0];
+}
+
+static int tevs_enum_mbus_code(struct v4l2_subdev *sd,
+			       struct v4l2_subdev_pad_config *cfg,
+			       struct v4l2_subdev_mbus_code_enum *code)
+{
+	struct camera_common_data *s_data = to_camera_common_data(sd->dev);
+	struct tevs *tevs = (struct tevs *)s_data->priv;
+	u32 index = code->index;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(tevs_formats); i++) {
+		if (!tevs_format_supported(tevs, &tevs_formats[i]))
+			continue;
+		if (index-- == 0) {
+			code->code = tevs_formats[i].code;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static int tevs_get_fmt(struct v4l2_subdev *sd,
+			struct v4l2_subdev_pad_config *cfg,
+			struct v4l2_subdev_format *format)
+{
+	struct camera_common_data *s_data = to_camera_common_data(sd->dev);
+	struct tevs *tevs = (struct tevs *)s_data->priv;
+	int ret;
+
+	ret = tevs->tc_pad_ops->get_fmt(sd, cfg, format);
+	if (ret)
+		return ret;
+
+	/* tegracam reports the table mode, the ISP outputs the scaler size */
+	if (format->which == V4L2_SUBDEV_FORMAT_ACTIVE) {
+		format->format.width = tevs->out_width;
+		format->format.height = tevs->out_height;
+		format->format.code = tevs->format->code;
+	}
+
+	return 0;
+}
+
+/*
+ * Accept any output size the ISP scaler can produce: the framework only
+ * knows the sensor modes, so hand it the mode that will be used and
+ * keep the requested size in out_width/out_height. The same applies to
+ * the media bus code, which the ISP converts through PREVIEW_FORMAT.
+ */
+static int tevs_set_fmt(struct v4l2_subdev *sd,
+			struct v4l2_subdev_pad_config *cfg,
+			struct v4l2_subdev_format *format)
+{
+	struct camera_common_data *s_data = to_camera_common_data(sd->dev);
+	struct tevs *tevs = (struct tevs *)s_data->priv;
+	struct v4l2_mbus_framefmt *mf = &format->format;
+	const struct tevs_format *fmt;
+	u32 width = mf->width;
+	u32 height = mf->height;
+	int mode, ret;
+
+	if (READ_ONCE(tevs->fw_busy))
+		return -EBUSY;
+
+	fmt = tevs_find_format(tevs, mf->code);
+	if (fmt == NULL)
+		fmt = tevs_default_format(tevs);
+
+	tevs_clamp_out_size(tevs, &width, &height);
+	mode = tevs_find_mode(tevs, width, height);
+
+	mf->width = tevs_sensor_table[tevs->selected_sensor].frmfmt[mode].size.width;
+	mf->height = tevs_sensor_table[tevs->selected_sensor].frmfmt[mode].size.height;
+	if (s_data->colorfmt)
+		mf->code = s_data->colorfmt->code;
+	ret = tevs->tc_pad_ops->set_fmt(sd, cfg, format);
+	if (ret)
+		return ret;
+
+	dev_dbg(tevs->dev, "%s() %ux%u code 0x%x from mode %dx%d\n", __func__,
+		width, height, fmt->code, mf->width, mf->height);
+
+	mf->width = width;
+	mf->height = height;
+	mf->code = fmt->code;
+	if (format->which == V4L2_SUBDEV_FORMAT_ACTIVE) {
+		tevs->out_width = width;
+		tevs->out_height = height;
+		tevs->format = fmt;
+	}
+
+	return 0;
+}
+
+static int tevs_subscribe_event(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+				struct v4l2_event_subscription *sub)
+{
+	switch (sub->type) {
+	case V4L2_EVENT_CTRL:
+		return v4l2_ctrl_subdev_subscribe_event(sd, fh, sub);
+	case V4L2_EVENT_TEVS_AE_CONVERGED:
+		return v4l2_event_subscribe(fh, sub, 2, NULL);
+	default:
+		return -EINVAL;
+	}
+}
+
+static long tevs_ioctl(struct v4l2_subdev *sd, unsigned int cmd, void *arg)
+{
+	struct camera_common_data *s_data = to_camera_common_data(sd->dev);
+	struct tevs *tevs = (struct tevs *)s_data->priv;
+	struct tevs_sensor_reg_batch *batch = arg;
+
+	switch (cmd) {
+	case VIDIOC_TEVS_SENSOR_REG_BATCH:
+		if (batch->count > TEVS_SENSOR_REG_BATCH_MAX)
+			return -EINVAL;
+		return tevs_sensor_reg_batch(sd, batch->ops, batch->count);
+	default:
+		if (tevs->tc_ioctl)
+			return tevs->tc_ioctl(sd, cmd, arg);
+		return -ENOIOCTLCMD;
+	}
+}
+
+#ifdef CONFIG_COMPAT
+/*
+ * struct tevs_sensor_reg_batch is made of fixed-size fields only, so a
+ * 32-bit caller passes the same layout; just copy it in and out.
+ */
+static long tevs_compat_ioctl32(struct v4l2_subdev *sd, unsigned int cmd,
+				unsigned long arg)
+{
+	struct camera_common_data *s_data = to_camera_common_data(sd->dev);
+	struct tevs *tevs = (struct tevs *)s_data->priv;
+	struct tevs_sensor_reg_batch *batch;
+	void __user *uarg = compat_ptr(arg);
+	long ret;
+
+	switch (cmd) {
+	case VIDIOC_TEVS_SENSOR_REG_BATCH:
+		batch = memdup_user(uarg, sizeof(*batch));
+		if (IS_ERR(batch))
+			return PTR_ERR(batch);
+		ret = tevs_ioctl(sd, cmd, batch);
+		if (ret == 0 && copy_to_user(uarg, batch, sizeof(*batch)))
+			ret = -EFAULT;
+		kfree(batch);
+		return ret;
+	default:
+		if (tevs->tc_compat_ioctl32)
+			return tevs->tc_compat_ioctl32(sd, cmd, arg);
+		return -ENOIOCTLCMD;
+	}
+}
+#endif
+
+/*
+ * tegracam has no hook for pad, video or core ops, so wrap the ones it
+ * registered. Only the callbacks listed here are replaced; everything
+ * else stays tegracam's, which is checked to be present first.
+ */
+static int tevs_register_subdev_ops(struct tevs *tevs)
+{
+	struct v4l2_subdev *sd = tevs->v4l2_subdev;
+
+	if (!sd->ops || !sd->ops->video || !sd->ops->pad ||
+	    !sd->ops->pad->set_fmt || !sd->ops->pad->get_fmt)
+		return -EINVAL;
+
+	tevs->subdev_ops = *sd->ops;
+	if (sd->ops->core)
+		tevs->core_ops = *sd->ops->core;
+	tevs->core_ops.subscribe_event = tevs_subscribe_event;
+	tevs->core_ops.unsubscribe_event = v4l2_event_subdev_unsubscribe;
+	tevs->tc_ioctl = tevs->core_ops.ioctl;
+	tevs->core_ops.ioctl = tevs_ioctl;
+#ifdef CONFIG_COMPAT
+	tevs->tc_compat_ioctl32 = tevs->core_ops.compat_ioctl32;
+	tevs->core_ops.compat_ioctl32 = tevs_compat_ioctl32;
+#endif
+	tevs->subdev_ops.core = &tevs->core_ops;
+	tevs->video_ops = *sd->ops->video;
+	tevs->video_ops.g_frame_interval = tevs_g_frame_interval;
+	tevs->video_ops.s_frame_interval = tevs_s_frame_interval;
+	tevs->subdev_ops.video = &tevs->video_ops;
+	tevs->tc_pad_ops = sd->ops->pad;
+	tevs->pad_ops = *sd->ops->pad;
+	tevs->pad_ops.enum_mbus_code = tevs_enum_mbus_code;
+	tevs->pad_ops.get_fmt = tevs_get_fmt;
+	tevs->pad_ops.set_fmt = tevs_set_fmt;
+	tevs->subdev_ops.pad = &tevs->pad_ops;
+	sd->ops = &tevs->subdev_ops;
+
+	return 0;
+}
+
+static inline int tevs_read_reg(struct camera_common_data *s_data,
+	u16 addr, u8 *val)
+{
+	int err = 0;
+	u32 reg_val = 0;
+
+	err = regmap_read(s_data->regmap, addr, &reg_val);
+	*val = reg_val & 0xff;
+
+	return err;
+}
+
+static inline int tevs_write_reg(struct camera_common_data *s_data,
+	u16 addr, u8 val)
+{
+	int err = 0;
+
+	err = regmap_write(s_data->regmap, addr, val);
+	if (err)
+		dev_err(s_data->dev, "%s: i2c write failed, 0x%x = %x",
+			__func__, addr, val);
+
+	return err;
+}
+
+static struct camera_common_sensor_ops tevs_common_ops = {
+	.numfrmfmts = ARRAY_SIZE(sensor_frmfmt),
+	.frmfmt_table = sensor_frmfmt,
+	.power_on = tevs_power_on,
+	.power_off = tevs_power_off,
+	.write_reg = tevs_write_reg,
+	.read_reg = tevs_read_reg,
+	.parse_dt = tevs_parse_dt,
+	.power_get = tevs_power_get,
+	.power_put = tevs_power_put,
+	.set_mode = tevs_set_mode,
+	.start_streaming = tevs_start_streaming,
+	.stop_streaming = tevs_stop_streaming,
+};
+
+/* -----------------------------------------------------------------------------
+ * V4L2 Controls
+ */
+
+static int tevs_set_brightness(struct tevs *tevs, s32 value)
+{
+	// Format is u3.12
+	return tevs_i2c_write_16b(tevs, TEVS_BRIGHTNESS,
+				    value & TEVS_BRIGHTNESS_MASK);
+}
+
+static int tevs_get_brightness(struct tevs *tevs, s32 *value)
+{
+	u16 val;
+	int ret;
+	ret = tevs_i2c_read_16b(tevs, TEVS_BRIGHTNESS,
+				  &val);
+	if (ret)
+		return ret;
+
+	*value = val & TEVS_BRIGHTNESS_MASK;
+	return 0;
+}
+
+static int tevs_get_brightness_max(struct tevs *tevs, s64 *value)
+{
+	u16 val;
 	int ret;
 	ret = tevs_i2c_read_16b(tevs, TEVS_BRIGHTNESS_MAX,
 				  &val);
@@ -1113,6 +2559,61 @@ static int tevs_get_exposure_min(struct tevs *tevs, s64 *value)
 	return 0;
 }
 
+/*
+ * Upper limit of the exposure time the ISP may choose in auto exposure
+ * mode (us). Keeping it below the frame period makes AE raise the gain
+ * instead of stretching the exposure and dropping the frame rate.
+ */
+static int tevs_set_exp_time_upper(struct tevs *tevs, s32 value)
+{
+	u8 val[4];
+	__be32 temp;
+
+	temp = cpu_to_be32(value & TEVS_AE_EXP_TIME_UPPER_MASK);
+	memcpy(val, &temp, 4);
+
+	return tevs_i2c_write(tevs, TEVS_AE_EXP_TIME_UPPER, val, 4);
+}
+
+static int tevs_get_exp_time_upper(struct tevs *tevs, s32 *value)
+{
+	u8 val[4] = { 0 };
+	int ret;
+
+	ret = tevs_i2c_read(tevs, TEVS_AE_EXP_TIME_UPPER, val, 4);
+	if (ret)
+		return ret;
+
+	*value = be32_to_cpup((__be32*)val);
+	return 0;
+}
+
+static int tevs_get_exp_time_upper_max(struct tevs *tevs, s64 *value)
+{
+	u8 val[4] = { 0 };
+	int ret;
+
+	ret = tevs_i2c_read(tevs, TEVS_AE_EXP_TIME_UPPER_MAX, val, 4);
+	if (ret)
+		return ret;
+
+	*value = be32_to_cpup((__be32*)val);
+	return 0;
+}
+
+static int tevs_get_exp_time_upper_min(struct tevs *tevs, s64 *value)
+{
+	u8 val[4] = { 0 };
+	int ret;
+
+	ret = tevs_i2c_read(tevs, TEVS_AE_EXP_TIME_UPPER_MIN, val, 4);
+	if (ret)
+		return ret;
+
+	*value = be32_to_cpup((__be32*)val);
+	return 0;
+}
+
 static int tevs_set_gain(struct tevs *tevs, s32 value)
 {
 	return tevs_i2c_write_16b(tevs, TEVS_AE_MANUAL_GAIN,
@@ -1375,6 +2876,50 @@ static int tevs_get_sharpen_min(struct tevs *tevs, s64 *value)
 	return 0;
 }
 
+static int tevs_set_denoise(struct tevs *tevs, s32 value)
+{
+	return tevs_i2c_write_16b(tevs, TEVS_DENOISE,
+				    value & TEVS_DENOISE_MASK);
+}
+
+static int tevs_get_denoise(struct tevs *tevs, s32 *value)
+{
+	u16 val;
+	int ret;
+	ret = tevs_i2c_read_16b(tevs, TEVS_DENOISE, &val);
+	if (ret)
+		return ret;
+
+	*value = val & TEVS_DENOISE_MASK;
+	return 0;
+}
+
+static int tevs_get_denoise_max(struct tevs *tevs, s64 *value)
+{
+	u16 val;
+	int ret;
+	ret = tevs_i2c_read_16b(tevs, TEVS_DENOISE_MAX,
+				  &val);
+	if (ret)
+		return ret;
+
+	*value = val & TEVS_DENOISE_MASK;
+	return 0;
+}
+
+static int tevs_get_denoise_min(struct tevs *tevs, s64 *value)
+{
+	u16 val;
+	int ret;
+	ret = tevs_i2c_read_16b(tevs, TEVS_DENOISE_MIN,
+				  &val);
+	if (ret)
+		return ret;
+
+	*value = val & TEVS_DENOISE_MASK;
+	return 0;
+}
+
 static int tevs_set_backlight_compensation(struct tevs *tevs, s32 value)
 {
 	return tevs_i2c_write_16b(tevs,
@@ -1503,76 +3048,257 @@ static int tevs_set_special_effect(struct tevs *tevs, s32 mode)
 		break;
 	}
 
-	return tevs_i2c_write_16b(tevs, TEVS_SFX_MODE, val);
+	return tevs_i2c_write_16b(tevs, TEVS_SFX_MODE, val);
+}
+
+static int tevs_get_special_effect(struct tevs *tevs, s32 *mode)
+{
+	u16 val;
+	int ret;
+
+	ret = tevs_i2c_read_16b(tevs, TEVS_SFX_MODE, &val);
+	if (ret)
+		return ret;
+
+	switch (val & TEVS_SFX_MODE_SFX_MASK) {
+	case TEVS_SFX_MODE_SFX_NORMAL:
+		*mode = 0;
+		break;
+	case TEVS_SFX_MODE_SFX_BW:
+		*mode = 1;
+		break;
+	case TEVS_SFX_MODE_SFX_GRAYSCALE:
+		*mode = 2;
+		break;
+	case TEVS_SFX_MODE_SFX_NEGATIVE:
+		*mode = 3;
+		break;
+	case TEVS_SFX_MODE_SFX_SKETCH:
+		*mode = 4;
+		break;
+	default:
+		*mode = 0;
+		break;
+	}
+
+	return 0;
+}
+
+static const char *const ae_mode_strings[] = {
+	"Manual Mode", // TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN
+	"Auto Mode", // TEVS_AE_CTRL_FULL_AUTO
+	NULL,
+};
+
+static int __tevs_set_bsl_mode(struct tevs *tevs, s32 mode)
+{
+	struct i2c_client *client = tevs->tc_dev->client;
+	int ret = 0;
+	dev_dbg(tevs->dev, "%s(): set bls mode: %d", __func__, mode);
+
+	switch (mode) {
+	case 0:
+		ret = tevs_bsl_start_app(client);
+		break;
+	case 1:
+		gpiod_set_value_cansleep(tevs->reset_gpio, 0);
+		usleep_range(9000, 10000);
+		gpiod_set_value_cansleep(tevs->standby_gpio, 1);
+		msleep(100);
+		gpiod_set_value_cansleep(tevs->reset_gpio, 1);
+		usleep_range(9000, 10000);
+		gpiod_set_value_cansleep(tevs->standby_gpio, 0);
+		msleep(100);
+		ret = tevs_bsl_connect(client);
+		break;
+	default:
+		dev_err(tevs->dev, "%s(): set err bls mode: %d", __func__, mode);
+		break;
+	}
+
+	return ret;
+}
+
+/*
+ * Called from s_ctrl. fw_busy keeps streaming out during the switch,
+ * so state_lock is not held across it.
+ */
+static int tevs_set_bsl_mode(struct tevs *tevs, s32 mode)
+{
+	int ret;
+
+	mutex_lock(&tevs->state_lock);
+	if (tevs->streaming || tevs->fw_busy) {
+		mutex_unlock(&tevs->state_lock);
+		return -EBUSY;
+	}
+	tevs->fw_busy = true;
+	mutex_unlock(&tevs->state_lock);
+
+	ret = __tevs_set_bsl_mode(tevs, mode);
+
+	mutex_lock(&tevs->state_lock);
+	tevs->fw_busy = false;
+	mutex_unlock(&tevs->state_lock);
+
+	return ret;
+}
+
+/*
+ * Flash the MCU firmware: enter the bootloader, unlock, mass erase,
+ * program the image in the largest packets the bootloader accepts,
+ * compare the bootloader's CRC of the written range with the image and
+ * start the new application.
+ */
+static int tevs_fw_flash(struct tevs *tevs, const struct firmware *fw)
+{
+	struct i2c_client *client = tevs->tc_dev->client;
+	static const u8 pad[TEVS_BSL_PROGRAM_ALIGN] = {
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	};
+	size_t size = ALIGN(fw->size, TEVS_BSL_PROGRAM_ALIGN);
+	size_t offset, chunk, n;
+	u16 buffer_size;
+	u32 crc, dev_crc;
+	int ret;
+
+	/* the erase can't be undone, reject what can't be written back whole */
+	if (size < TEVS_BSL_VERIFY_MIN_LEN || size > TEVS_FW_FLASH_SIZE) {
+		dev_err(tevs->dev, "firmware size %zu out of range %d..%d\n",
+			fw->size, TEVS_BSL_VERIFY_MIN_LEN, TEVS_FW_FLASH_SIZE);
+		return -EINVAL;
+	}
+
+	ret = __tevs_set_bsl_mode(tevs, TEVS_BSL_MODE_FLASH_IDX);
+	if (ret)
+		return ret;
+
+	ret = tevs_bsl_unlock(client, tevs->bsl_password);
+	if (ret)
+		return ret;
+
+	chunk = TEVS_FW_DEFAULT_CHUNK;
+	if (tevs_bsl_get_buffer_size(client, &buffer_size) == 0 &&
+	    buffer_size > TEVS_BSL_PROGRAM_OVERHEAD + TEVS_BSL_PROGRAM_ALIGN)
+		chunk = buffer_size - TEVS_BSL_PROGRAM_OVERHEAD;
+	chunk = round_down(chunk, TEVS_BSL_PROGRAM_ALIGN);
+	dev_dbg(tevs->dev, "%s() %zu bytes in %zu byte packets\n", __func__,
+		fw->size, chunk);
+
+	ret = tevs_bsl_mass_erase(client);
+	if (ret)
+		return ret;
+	tevs->fw_progress = 5;
+
+	for (offset = 0; offset < fw->size; offset += n) {
+		n = min(chunk, fw->size - offset);
+		ret = tevs_bsl_program(client, TEVS_FW_FLASH_BASE + offset,
+				       fw->data + offset, n);
+		if (ret)
+			return ret;
+		tevs->fw_progress = 5 + div_u64((u64)offset * 90, fw->size);
+	}
+
+	crc = tevs_bsl_crc32(TEVS_BSL_CRC32_INIT, fw->data, fw->size);
+	crc = tevs_bsl_crc32(crc, pad, size - fw->size);
+	ret = tevs_bsl_verify(client, TEVS_FW_FLASH_BASE, size, &dev_crc);
+	if (ret)
+		return ret;
+	if (crc != dev_crc) {
+		dev_err(tevs->dev, "firmware verify failed: %08x != %08x\n",
+			dev_crc, crc);
+		return -EIO;
+	}
+	tevs->fw_progress = 98;
+
+	ret = __tevs_set_bsl_mode(tevs, TEVS_BSL_MODE_NORMAL_IDX);
+	if (ret)
+		return ret;
+
+	msleep(250);
+	ret = tevs_check_boot_state(tevs);
+	if (ret)
+		return ret;
+
+	ret = tevs_boot_setting(tevs);
+	if (ret)
+		return ret;
+
+	return tevs_init_setting(tevs);
 }
 
-static int tevs_get_special_effect(struct tevs *tevs, s32 *mode)
+/*
+ * The new application starts from its defaults: write every control
+ * back, then park the ISP in standby like probe does. Action controls
+ * (bootloader, presets, ramp) are skipped through ctrl_restore.
+ */
+static int tevs_fw_restore(struct tevs *tevs)
 {
-	u16 val;
 	int ret;
 
-	ret = tevs_i2c_read_16b(tevs, TEVS_SFX_MODE, &val);
-	if (ret)
+	mutex_lock(&tevs->lock);
+	tevs->ctrl_restore = true;
+	ret = __v4l2_ctrl_handler_setup(tevs->v4l2_subdev->ctrl_handler);
+	tevs->ctrl_restore = false;
+	mutex_unlock(&tevs->lock);
+	if (ret) {
+		dev_err(tevs->dev, "restoring controls failed: %d\n", ret);
 		return ret;
-
-	switch (val & TEVS_SFX_MODE_SFX_MASK) {
-	case TEVS_SFX_MODE_SFX_NORMAL:
-		*mode = 0;
-		break;
-	case TEVS_SFX_MODE_SFX_BW:
-		*mode = 1;
-		break;
-	case TEVS_SFX_MODE_SFX_GRAYSCALE:
-		*mode = 2;
-		break;
-	case TEVS_SFX_MODE_SFX_NEGATIVE:
-		*mode = 3;
-		break;
-	case TEVS_SFX_MODE_SFX_SKETCH:
-		*mode = 4;
-		break;
-	default:
-		*mode = 0;
-		break;
 	}
 
-	return 0;
-}
+	if (!(tevs->hw_reset_mode | tevs->trigger_mode))
+		ret = tevs_standby(tevs, 1);
 
-static const char *const ae_mode_strings[] = {
-	"Manual Mode", // TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN
-	"Auto Mode", // TEVS_AE_CTRL_FULL_AUTO
-	NULL,
-};
+	return ret;
+}
 
-static int tevs_set_bsl_mode(struct tevs *tevs, s32 mode)
+static void tevs_fw_update_work(struct work_struct *work)
 {
-	u8 val;
-	u8 bootcmd[6] = {0x00, 0x12, 0x3A, 0x61, 0x44, 0xDE};
-	u8 startup[6] = {0x00, 0x40, 0xE2, 0x51, 0x21, 0x5B};
-	dev_dbg(tevs->dev, "%s(): set bls mode: %d", __func__, mode);
+	struct tevs *tevs = container_of(work, struct tevs, fw_work);
+	const struct firmware *fw;
+	int ret;
 
-	switch (mode) {
-	case 0:
-		tevs_i2c_write(tevs, 0x8001, startup, 6);
-		tevs_i2c_read(tevs, 0x8001, &val, 1);
-		break;
-	case 1:
-		gpiod_set_value_cansleep(tevs->reset_gpio, 0);
-		usleep_range(9000, 10000);
-		gpiod_set_value_cansleep(tevs->standby_gpio, 1);
-		msleep(100);
-		gpiod_set_value_cansleep(tevs->reset_gpio, 1);
-		usleep_range(9000, 10000);
-		gpiod_set_value_cansleep(tevs->standby_gpio, 0);
-		msleep(100);
-		tevs_i2c_write(tevs, 0x8001, bootcmd, 6);
-		tevs_i2c_read(tevs, 0x8001, &val, 1);
-		break;
-	default:
-		dev_err(tevs->dev, "%s(): set err bls mode: %d", __func__, mode);
-		break;
+	ret = request_firmware(&fw, tevs->fw_name, tevs->dev);
+	if (ret) {
+		dev_err(tevs->dev, "cannot load %s: %d\n", tevs->fw_name, ret);
+		goto out;
+	}
+
+	dev_info(tevs->dev, "updating firmware from %s (%zu bytes)\n",
+		 tevs->fw_name, fw->size);
+	ret = tevs_fw_flash(tevs, fw);
+	release_firmware(fw);
+	if (ret == 0)
+		ret = tevs_fw_restore(tevs);
+	if (ret)
+		dev_err(tevs->dev, "firmware update failed: %d\n", ret);
+	else
+		dev_info(tevs->dev, "firmware update done\n");
+
+out:
+	tevs->fw_progress = ret ? ret : 100;
+	mutex_lock(&tevs->state_lock);
+	tevs->fw_busy = false;
+	mutex_unlock(&tevs->state_lock);
+}
+
+/*
+ * fw_busy keeps streaming, power changes, format changes, control and
+ * sensor register access out while the work runs, without holding
+ * state_lock for the whole flash. Called from s_ctrl.
+ */
+static int tevs_fw_update(struct tevs *tevs)
+{
+	mutex_lock(&tevs->state_lock);
+	if (tevs->streaming || tevs->fw_busy) {
+		mutex_unlock(&tevs->state_lock);
+		return -EBUSY;
 	}
+	tevs->fw_busy = true;
+	mutex_unlock(&tevs->state_lock);
+
+	tevs->fw_progress = 0;
+	schedule_work(&tevs->fw_work);
 
 	return 0;
 }
@@ -1681,15 +3407,230 @@ static int tevs_get_pan_tilt_target_min(struct tevs *tevs, s64 *value)
 	return 0;
 }
 
+static int tevs_try_dz_roi(struct tevs *tevs, const u16 *roi)
+{
+	if (roi[TEVS_DZ_ROI_X] < tevs->dz_ct_min ||
+	    roi[TEVS_DZ_ROI_X] > tevs->dz_ct_max ||
+	    roi[TEVS_DZ_ROI_Y] < tevs->dz_ct_min ||
+	    roi[TEVS_DZ_ROI_Y] > tevs->dz_ct_max ||
+	    roi[TEVS_DZ_ROI_ZOOM] < tevs->dz_zoom_min ||
+	    roi[TEVS_DZ_ROI_ZOOM] > tevs->dz_zoom_max)
+		return -ERANGE;
+
+	return 0;
+}
+
+/*
+ * The centre goes out as one register write, so the ISP never sees a
+ * new x with an old y. The zoom factor is a separate write; a frame
+ * can still fall between the two.
+ */
+static int tevs_set_dz_roi(struct tevs *tevs, const u16 *roi)
+{
+	u8 val[4];
+	int ret;
+
+	/* CT_X and CT_Y are adjacent */
+	val[0] = roi[TEVS_DZ_ROI_X] >> 8;
+	val[1] = roi[TEVS_DZ_ROI_X] & 0xFF;
+	val[2] = roi[TEVS_DZ_ROI_Y] >> 8;
+	val[3] = roi[TEVS_DZ_ROI_Y] & 0xFF;
+	ret = tevs_i2c_write(tevs, TEVS_DZ_CT_X, val, 4);
+	if (ret)
+		return ret;
+
+	return tevs_i2c_write_16b(tevs, TEVS_DZ_TGT_FCT,
+				  roi[TEVS_DZ_ROI_ZOOM] & TEVS_DZ_TGT_FCT_MASK);
+}
+
+static int tevs_get_dz_roi(struct tevs *tevs, u16 *roi)
+{
+	u8 val[4];
+	u16 zoom;
+	int ret;
+
+	/* CT_X and CT_Y are adjacent */
+	ret = tevs_i2c_read(tevs, TEVS_DZ_CT_X, val, 4);
+	if (ret)
+		return ret;
+	ret = tevs_i2c_read_16b(tevs, TEVS_DZ_TGT_FCT, &zoom);
+	if (ret)
+		return ret;
+
+	roi[TEVS_DZ_ROI_X] = (val[0] << 8) | val[1];
+	roi[TEVS_DZ_ROI_Y] = (val[2] << 8) | val[3];
+	roi[TEVS_DZ_ROI_ZOOM] = zoom & TEVS_DZ_TGT_FCT_MASK;
+	return 0;
+}
+
+static int tevs_set_throughput(struct tevs *tevs, s32 value)
+{
+	int ret;
+
+	ret = tevs_validate_throughput(tevs, value);
+	if (ret)
+		return ret;
+
+	ret = tevs_i2c_write_16b(tevs, HOST_COMMAND_ISP_CTRL_PREVIEW_THROUGHPUT,
+				 value);
+	if (ret)
+		return ret;
+
+	tevs->throughput = value;
+	return 0;
+}
+
+static int tevs_get_throughput(struct tevs *tevs, s32 *value)
+{
+	u16 val;
+	int ret;
+	ret = tevs_i2c_read_16b(tevs, HOST_COMMAND_ISP_CTRL_PREVIEW_THROUGHPUT,
+				  &val);
+	if (ret)
+		return ret;
+
+	*value = val;
+	return 0;
+}
+
+static int tevs_get_effective_fps(struct tevs *tevs, s32 *value)
+{
+	u16 val;
+	int ret;
+	ret = tevs_i2c_read_16b(tevs, HOST_COMMAND_ISP_CTRL_PREVIEW_MAX_FPS,
+				  &val);
+	if (ret)
+		return ret;
+
+	*value = val;
+	return 0;
+}
+
+static int tevs_get_current_exposure(struct tevs *tevs, s32 *value)
+{
+	struct tevs_ae_sample cur;
+	int ret;
+
+	ret = tevs_read_current_ae(tevs, &cur);
+	if (ret)
+		return ret;
+
+	*value = cur.exposure;
+	return 0;
+}
+
+static int tevs_get_current_gain(struct tevs *tevs, s32 *value)
+{
+	struct tevs_ae_sample cur;
+	int ret;
+
+	ret = tevs_read_current_ae(tevs, &cur);
+	if (ret)
+		return ret;
+
+	*value = cur.gain & TEVS_AE_MANUAL_GAIN_MASK;
+	return 0;
+}
+
 static const char *const bsl_mode_strings[] = {
 	"Normal Mode",
 	"Bootstrap Mode",
 	NULL,
 };
 
-static int tevs_s_ctrl(struct v4l2_ctrl *ctrl)
+static const char * const tevs_preset_strings[] = {
+	"Preset 1",
+	"Preset 2",
+	"Preset 3",
+	"Preset 4",
+	NULL,
+};
+
+/* Called from s_ctrl, so the control handler lock is already held */
+static int tevs_preset_save(struct tevs *tevs, struct v4l2_ctrl *ctrl,
+			    int slot)
+{
+	struct tevs_preset *preset = &tevs->presets[slot];
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(tevs_preset_ctrls); i++) {
+		if (tevs->preset_ctrls[i] == NULL)
+			return -EINVAL;
+		preset->vals[i] = tevs->preset_ctrls[i]->cur.val;
+	}
+	preset->valid = true;
+
+	return 0;
+}
+
+/*
+ * Only controls that differ from the current state are set. Register
+ * controls are collected by the coalescer and sent as one burst at the
+ * end, mode controls are written in order ahead of them. The burst is
+ * sent before returning, so its failure fails the apply.
+ */
+static int tevs_preset_apply(struct tevs *tevs, struct v4l2_ctrl *ctrl,
+			     int slot)
+{
+	struct tevs_preset *preset = &tevs->presets[slot];
+	struct v4l2_ctrl *c;
+	int i, err, ret = 0;
+
+	if (!preset->valid)
+		return -ENODATA;
+
+	tevs->ctrl_batch = true;
+	for (i = 0; i < ARRAY_SIZE(tevs_preset_ctrls); i++) {
+		c = tevs->preset_ctrls[i];
+		if (c == NULL || c->cur.val == preset->vals[i])
+			continue;
+		ret = __v4l2_ctrl_s_ctrl(c, preset->vals[i]);
+		if (ret) {
+			dev_err(tevs->dev, "preset: setting '%s' failed\n",
+				c->name);
+			break;
+		}
+	}
+	tevs->ctrl_batch = false;
+	err = tevs_ctrl_flush(tevs);
+	if (err && ret == 0) {
+		dev_err(tevs->dev, "preset: writing the registers failed\n");
+		ret = err;
+	}
+
+	return ret;
+}
+
+static int __tevs_s_ctrl(struct v4l2_ctrl *ctrl)
 {
 	struct tevs *tevs = _to_tevs_priv(ctrl);
+	int ret;
+
+	if (tevs->ctrl_restore) {
+		switch (ctrl->id) {
+		case V4L2_CID_TEVS_BSL_MODE:
+		case V4L2_CID_TEVS_AE_RAMP:
+		case V4L2_CID_TEVS_PRESET_SAVE:
+		case V4L2_CID_TEVS_PRESET_APPLY:
+			return 0;
+		default:
+			break;
+		}
+	}
+
+	/*
+	 * While streaming or applying a preset, plain register controls go
+	 * through the coalescer. A stream that starts or stops right after
+	 * the check only changes how the value gets to the ISP, not whether.
+	 */
+	if (READ_ONCE(tevs->streaming) || tevs->ctrl_batch) {
+		if (ctrl->id == V4L2_CID_EXPOSURE || ctrl->id == V4L2_CID_GAIN)
+			tevs_ae_ramp_stop(tevs);
+		ret = tevs_ctrl_queue(tevs, ctrl->id, ctrl->val);
+		if (ret != -ENOENT)
+			return ret;
+		tevs_ctrl_flush(tevs);
+	}
 
 	switch (ctrl->id) {
 	case V4L2_CID_BRIGHTNESS:
@@ -1708,9 +3649,11 @@ static int tevs_s_ctrl(struct v4l2_ctrl *ctrl)
 		return tevs_set_gamma(tevs, ctrl->val);
 
 	case V4L2_CID_EXPOSURE:
+		tevs_ae_ramp_stop(tevs);
 		return tevs_set_exposure(tevs, ctrl->val);
 
 	case V4L2_CID_GAIN:
+		tevs_ae_ramp_stop(tevs);
 		return tevs_set_gain(tevs, ctrl->val);
 
 	case V4L2_CID_HFLIP:
@@ -1728,6 +3671,12 @@ static int tevs_s_ctrl(struct v4l2_ctrl *ctrl)
 	case V4L2_CID_SHARPNESS:
 		return tevs_set_sharpen(tevs, ctrl->val);
 
+	case V4L2_CID_TEVS_DENOISE:
+		return tevs_set_denoise(tevs, ctrl->val);
+
+	case V4L2_CID_TEVS_FW_UPDATE:
+		return tevs_fw_update(tevs);
+
 	case V4L2_CID_BACKLIGHT_COMPENSATION:
 		return tevs_set_backlight_compensation(tevs, ctrl->val);
 
@@ -1735,7 +3684,22 @@ static int tevs_s_ctrl(struct v4l2_ctrl *ctrl)
 		return tevs_set_special_effect(tevs, ctrl->val);
 
 	case V4L2_CID_EXPOSURE_AUTO:
-		return tevs_set_ae_mode(tevs, ctrl->val);
+		tevs_ae_ramp_stop(tevs);
+		ret = tevs_set_ae_mode(tevs, ctrl->val);
+		if (ret == 0 && ctrl->val == TEVS_AE_CTRL_FULL_AUTO_IDX) {
+			/* stream stop cancels the monitor under state_lock */
+			mutex_lock(&tevs->state_lock);
+			if (tevs->streaming)
+				tevs_ae_monitor_start(tevs);
+			mutex_unlock(&tevs->state_lock);
+		}
+		/* AE and tevs_ae_seed() leave their own values behind */
+		if (ret == 0 && ctrl->val == TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN_IDX &&
+		    tevs->exposure_ctrl && tevs->gain_ctrl)
+			ret = tevs_write_exposure_gain(tevs,
+						       tevs->exposure_ctrl->cur.val,
+						       tevs->gain_ctrl->cur.val);
+		return ret;
 
 	case V4L2_CID_PAN_ABSOLUTE:
 		return tevs_set_pan_target(tevs, ctrl->val);
@@ -1748,6 +3712,28 @@ static int tevs_s_ctrl(struct v4l2_ctrl *ctrl)
 	case V4L2_CID_TEVS_BSL_MODE:
 		return tevs_set_bsl_mode(tevs, ctrl->val);
 
+	case V4L2_CID_TEVS_EXP_TIME_UPPER:
+		return tevs_set_exp_time_upper(tevs, ctrl->val);
+
+	case V4L2_CID_TEVS_THROUGHPUT:
+		return tevs_set_throughput(tevs, ctrl->val);
+
+	case V4L2_CID_TEVS_AE_SEED:
+		tevs->ae_seed = ctrl->val;
+		return 0;
+
+	case V4L2_CID_TEVS_DZ_ROI:
+		return tevs_set_dz_roi(tevs, ctrl->p_new.p_u16);
+
+	case V4L2_CID_TEVS_AE_RAMP:
+		return tevs_ae_ramp(tevs, ctrl->p_new.p_u32);
+
+	case V4L2_CID_TEVS_PRESET_SAVE:
+		return tevs_preset_save(tevs, ctrl, ctrl->val);
+
+	case V4L2_CID_TEVS_PRESET_APPLY:
+		return tevs_preset_apply(tevs, ctrl, ctrl->val);
+
 	default:
 		dev_dbg(tevs->dev, "Unknown control 0x%x\n",
 			ctrl->id);
@@ -1755,6 +3741,29 @@ static int tevs_s_ctrl(struct v4l2_ctrl *ctrl)
 	}
 }
 
+/*
+ * state_lock is only taken by the helpers that look at or change the
+ * stream, ramp or firmware state, so a control write does not wait for
+ * a stream transition to finish polling the ISP.
+ */
+static int tevs_s_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct tevs *tevs = _to_tevs_priv(ctrl);
+
+	if (tevs->ctrl_sync)
+		return 0;
+
+	/* tevs_fw_restore() writes the controls back while still busy */
+	if (READ_ONCE(tevs->fw_busy) && !tevs->ctrl_restore)
+		return -EBUSY;
+
+	return __tevs_s_ctrl(ctrl);
+}
+
+/*
+ * Reads a control from the ISP: once for every control at init, later
+ * only for volatile controls (see tevs_set_hw_ctrl_read()).
+ */
 static int tevs_g_ctrl(struct v4l2_ctrl *ctrl)
 {
 	struct tevs *tevs = _to_tevs_priv(ctrl);
@@ -1796,6 +3805,16 @@ static int tevs_g_ctrl(struct v4l2_ctrl *ctrl)
 	case V4L2_CID_SHARPNESS:
 		return tevs_get_sharpen(tevs, &ctrl->val);
 
+	case V4L2_CID_TEVS_DENOISE:
+		return tevs_get_denoise(tevs, &ctrl->val);
+
+	case V4L2_CID_TEVS_FW_UPDATE:
+		return 0;
+
+	case V4L2_CID_TEVS_FW_PROGRESS:
+		ctrl->val = tevs->fw_progress;
+		return 0;
+
 	case V4L2_CID_BACKLIGHT_COMPENSATION:
 		return tevs_get_backlight_compensation(tevs, &ctrl->val);
 
@@ -1805,26 +3824,104 @@ static int tevs_g_ctrl(struct v4l2_ctrl *ctrl)
 	case V4L2_CID_EXPOSURE_AUTO:
 		return tevs_get_ae_mode(tevs, &ctrl->val);
 
-	case V4L2_CID_PAN_ABSOLUTE:
-		return tevs_get_pan_target(tevs, &ctrl->val);
+	case V4L2_CID_PAN_ABSOLUTE:
+		return tevs_get_pan_target(tevs, &ctrl->val);
+
+	case V4L2_CID_TILT_ABSOLUTE:
+		return tevs_get_tilt_target(tevs, &ctrl->val);
+
+	case V4L2_CID_ZOOM_ABSOLUTE:
+		return tevs_get_zoom_target(tevs, &ctrl->val);
+
+	case V4L2_CID_TEVS_BSL_MODE:
+		return 0;
+
+	case V4L2_CID_TEVS_EXP_TIME_UPPER:
+		return tevs_get_exp_time_upper(tevs, &ctrl->val);
+
+	case V4L2_CID_TEVS_THROUGHPUT:
+		return tevs_get_throughput(tevs, &ctrl->val);
+
+	case V4L2_CID_TEVS_EFFECTIVE_FPS:
+		return tevs_get_effective_fps(tevs, &ctrl->val);
+
+	case V4L2_CID_TEVS_CURRENT_EXPOSURE:
+		return tevs_get_current_exposure(tevs, &ctrl->val);
+
+	case V4L2_CID_TEVS_CURRENT_GAIN:
+		return tevs_get_current_gain(tevs, &ctrl->val);
+
+	case V4L2_CID_TEVS_AE_SEED:
+		ctrl->val = tevs->ae_seed;
+		return 0;
+
+	case V4L2_CID_TEVS_DZ_ROI:
+		return tevs_get_dz_roi(tevs, ctrl->p_new.p_u16);
+
+	case V4L2_CID_TEVS_AE_RAMP:
+	case V4L2_CID_TEVS_PRESET_SAVE:
+	case V4L2_CID_TEVS_PRESET_APPLY:
+		return 0;
+
+	default:
+		dev_dbg(tevs->dev, "Unknown control 0x%x\n",
+			ctrl->id);
+		return -EINVAL;
+	}
+}
+
+static int tevs_g_volatile_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct tevs *tevs = _to_tevs_priv(ctrl);
+
+	/* the MCU is in its bootloader, only the progress can be read */
+	if (READ_ONCE(tevs->fw_busy) && ctrl->id != V4L2_CID_TEVS_FW_PROGRESS)
+		return -EBUSY;
+
+	/* a forced read-back should see the coalesced writes land first */
+	if (tevs->hw_ctrl_read)
+		tevs_ctrl_flush(tevs);
+
+	return tevs_g_ctrl(ctrl);
+}
+
+/* targets must fit the (ISP provided) manual exposure and gain ranges */
+static int tevs_try_ae_ramp(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	struct v4l2_ctrl *exposure = tevs->exposure_ctrl;
+	struct v4l2_ctrl *gain = tevs->gain_ctrl;
+	const u32 *ramp = ctrl->p_new.p_u32;
 
-	case V4L2_CID_TILT_ABSOLUTE:
-		return tevs_get_tilt_target(tevs, &ctrl->val);
+	if (exposure == NULL || gain == NULL)
+		return -EINVAL;
 
-	case V4L2_CID_ZOOM_ABSOLUTE:
-		return tevs_get_zoom_target(tevs, &ctrl->val);
+	if (ramp[TEVS_AE_RAMP_EXPOSURE] < exposure->minimum ||
+	    ramp[TEVS_AE_RAMP_EXPOSURE] > exposure->maximum ||
+	    ramp[TEVS_AE_RAMP_GAIN] < gain->minimum ||
+	    ramp[TEVS_AE_RAMP_GAIN] > gain->maximum ||
+	    ramp[TEVS_AE_RAMP_FRAMES] > TEVS_AE_RAMP_MAX_FRAMES)
+		return -ERANGE;
 
-	case V4L2_CID_TEVS_BSL_MODE:
-		return 0;
+	return 0;
+}
 
+static int tevs_try_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct tevs *tevs = _to_tevs_priv(ctrl);
+
+	switch (ctrl->id) {
+	case V4L2_CID_TEVS_DZ_ROI:
+		return tevs_try_dz_roi(tevs, ctrl->p_new.p_u16);
+	case V4L2_CID_TEVS_AE_RAMP:
+		return tevs_try_ae_ramp(tevs, ctrl);
 	default:
-		dev_dbg(tevs->dev, "Unknown control 0x%x\n",
-			ctrl->id);
-		return -EINVAL;
+		return 0;
 	}
 }
 
 static const struct v4l2_ctrl_ops tevs_ctrl_ops = {
+	.g_volatile_ctrl = tevs_g_volatile_ctrl,
+	.try_ctrl = tevs_try_ctrl,
 	.s_ctrl = tevs_s_ctrl,
 };
 
@@ -1947,6 +4044,37 @@ static const struct v4l2_ctrl_config tevs_ctrls[] = {
 		.step = 0x1,
 		.def = 0x0,
 	},
+	{
+		.ops = &tevs_ctrl_ops,
+		.id = V4L2_CID_TEVS_DENOISE,
+		.name = "Denoise",
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.min = 0x0,
+		.max = 0xFFFF,
+		.step = 0x1,
+		.def = 0x0,
+	},
+	{
+		.ops = &tevs_ctrl_ops,
+		.id = V4L2_CID_TEVS_FW_UPDATE,
+		.name = "Firmware_Update",
+		.type = V4L2_CTRL_TYPE_BUTTON,
+		.min = 0x0,
+		.max = 0x0,
+		.step = 0x0,
+		.def = 0x0,
+	},
+	{
+		.ops = &tevs_ctrl_ops,
+		.id = V4L2_CID_TEVS_FW_PROGRESS,
+		.name = "Firmware_Update_Progress",
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE,
+		.min = -MAX_ERRNO,
+		.max = 100,
+		.step = 0x1,
+		.def = 0x0,
+	},
 	{
 		.ops = &tevs_ctrl_ops,
 		.id = V4L2_CID_BACKLIGHT_COMPENSATION,
@@ -2014,6 +4142,114 @@ static const struct v4l2_ctrl_config tevs_ctrls[] = {
 		.def = TEVS_BSL_MODE_NORMAL_IDX,
 		.qmenu = bsl_mode_strings,
 	},
+	{
+		.ops = &tevs_ctrl_ops,
+		.id = V4L2_CID_TEVS_EXP_TIME_UPPER,
+		.name = "Exposure_Time_Upper",
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.min = 0x0,
+		.max = 0xF4240,
+		.step = 1,
+		.def = 0x8235, // 33333 us
+	},
+	{
+		.ops = &tevs_ctrl_ops,
+		.id = V4L2_CID_TEVS_THROUGHPUT,
+		.name = "MIPI_Throughput",
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.min = 0x0,
+		.max = 0xFFFF,
+		.step = 0x1,
+		.def = 0x0, // no limit
+	},
+	{
+		.ops = &tevs_ctrl_ops,
+		.id = V4L2_CID_TEVS_EFFECTIVE_FPS,
+		.name = "Effective_Frame_Rate",
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE,
+		.min = 0x0,
+		.max = 0xFFFF,
+		.step = 0x1,
+		.def = 0x0,
+	},
+	{
+		.ops = &tevs_ctrl_ops,
+		.id = V4L2_CID_TEVS_CURRENT_EXPOSURE,
+		.name = "Current_Exposure",
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE,
+		.min = 0x0,
+		.max = 0xF4240,
+		.step = 1,
+		.def = 0x0,
+	},
+	{
+		.ops = &tevs_ctrl_ops,
+		.id = V4L2_CID_TEVS_CURRENT_GAIN,
+		.name = "Current_Gain",
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE,
+		.min = 0x0,
+		.max = 0x40,
+		.step = 0x1,
+		.def = 0x0,
+	},
+	{
+		.ops = &tevs_ctrl_ops,
+		.id = V4L2_CID_TEVS_AE_SEED,
+		.name = "AE_Seed_Last_Session",
+		.type = V4L2_CTRL_TYPE_BOOLEAN,
+		.min = 0x0,
+		.max = 0x1,
+		.step = 0x1,
+		.def = 0x0,
+	},
+	{
+		.ops = &tevs_ctrl_ops,
+		.id = V4L2_CID_TEVS_DZ_ROI,
+		.name = "Digital_Zoom_ROI",
+		.type = V4L2_CTRL_TYPE_U16,
+		.flags = V4L2_CTRL_FLAG_VOLATILE |
+			 V4L2_CTRL_FLAG_EXECUTE_ON_WRITE,
+		.min = 0x0,
+		.max = 0xFFFF,
+		.step = 0x1,
+		.def = 0x0,
+		.dims = { TEVS_DZ_ROI_ELEMS },
+	},
+	{
+		.ops = &tevs_ctrl_ops,
+		.id = V4L2_CID_TEVS_AE_RAMP,
+		.name = "AE_Ramp",
+		.type = V4L2_CTRL_TYPE_U32,
+		.flags = V4L2_CTRL_FLAG_EXECUTE_ON_WRITE,
+		.min = 0x0,
+		.max = 0xFFFFFFFF,
+		.step = 0x1,
+		.def = 0x0,
+		.dims = { TEVS_AE_RAMP_ELEMS },
+	},
+	{
+		.ops = &tevs_ctrl_ops,
+		.id = V4L2_CID_TEVS_PRESET_SAVE,
+		.name = "Preset_Save",
+		.type = V4L2_CTRL_TYPE_MENU,
+		.flags = V4L2_CTRL_FLAG_EXECUTE_ON_WRITE,
+		.max = TEVS_PRESETS - 1,
+		.def = 0,
+		.qmenu = tevs_preset_strings,
+	},
+	{
+		.ops = &tevs_ctrl_ops,
+		.id = V4L2_CID_TEVS_PRESET_APPLY,
+		.name = "Preset_Apply",
+		.type = V4L2_CTRL_TYPE_MENU,
+		.flags = V4L2_CTRL_FLAG_EXECUTE_ON_WRITE,
+		.max = TEVS_PRESETS - 1,
+		.def = 0,
+		.qmenu = tevs_preset_strings,
+	},
 };
 
 static int tevs_ctrls_init(struct tevs *tevs)
@@ -2034,8 +4270,13 @@ static int tevs_ctrls_init(struct tevs *tevs)
 	}
 
 	for (i = 0; i < ARRAY_SIZE(tevs_ctrls); i++) {
-		struct v4l2_ctrl *ctrl = v4l2_ctrl_new_custom(
-			&ctrl_hdl->ctrl_handler, &tevs_ctrls[i], NULL);
+		struct v4l2_ctrl_config cfg = tevs_ctrls[i];
+		struct v4l2_ctrl *ctrl;
+
+		/* preset slots are labelled from the device tree */
+		if (cfg.qmenu == tevs_preset_strings)
+			cfg.qmenu = (const char * const *)tevs->preset_names;
+		ctrl = v4l2_ctrl_new_custom(&ctrl_hdl->ctrl_handler, &cfg, NULL);
 		ret = tevs_g_ctrl(ctrl);
 		if (!ret && ctrl->default_value != ctrl->val) {
 			// Updating default value based on firmware values
@@ -2069,15 +4310,30 @@ static int tevs_ctrls_init(struct tevs *tevs)
 			break;
 
 		case V4L2_CID_EXPOSURE:
+		case V4L2_CID_TEVS_CURRENT_EXPOSURE:
+			if (ctrl->id == V4L2_CID_EXPOSURE)
+				tevs->exposure_ctrl = ctrl;
 			tevs_get_exposure_max(tevs, &ctrl->maximum);
 			tevs_get_exposure_min(tevs, &ctrl->minimum);
 			break;
 
 		case V4L2_CID_GAIN:
+		case V4L2_CID_TEVS_CURRENT_GAIN:
+			if (ctrl->id == V4L2_CID_GAIN)
+				tevs->gain_ctrl = ctrl;
 			tevs_get_gain_max(tevs, &ctrl->maximum);
 			tevs_get_gain_min(tevs, &ctrl->minimum);
 			break;
 
+		case V4L2_CID_TEVS_EXP_TIME_UPPER:
+			tevs_get_exp_time_upper_max(tevs, &ctrl->maximum);
+			tevs_get_exp_time_upper_min(tevs, &ctrl->minimum);
+			break;
+
+		case V4L2_CID_TEVS_THROUGHPUT:
+			ctrl->maximum = tevs_link_capacity(tevs);
+			break;
+
 		case V4L2_CID_WHITE_BALANCE_TEMPERATURE:
 			tevs_get_awb_temp_max(tevs, &ctrl->maximum);
 			tevs_get_awb_temp_min(tevs, &ctrl->minimum);
@@ -2088,6 +4344,11 @@ static int tevs_ctrls_init(struct tevs *tevs)
 			tevs_get_sharpen_min(tevs, &ctrl->minimum);
 			break;
 
+		case V4L2_CID_TEVS_DENOISE:
+			tevs_get_denoise_max(tevs, &ctrl->maximum);
+			tevs_get_denoise_min(tevs, &ctrl->minimum);
+			break;
+
 		case V4L2_CID_BACKLIGHT_COMPENSATION:
 			tevs_get_backlight_compensation_max(tevs,
 							   &ctrl->maximum);
@@ -2104,6 +4365,19 @@ static int tevs_ctrls_init(struct tevs *tevs)
 		case V4L2_CID_ZOOM_ABSOLUTE:
 			tevs_get_zoom_target_max(tevs, &ctrl->maximum);
 			tevs_get_zoom_target_min(tevs, &ctrl->minimum);
+			break;
+
+		case V4L2_CID_TEVS_DZ_ROI:
+			/* per-element limits are checked in try_ctrl */
+			tevs_get_pan_tilt_target_max(tevs, &tevs->dz_ct_max);
+			tevs_get_pan_tilt_target_min(tevs, &tevs->dz_ct_min);
+			tevs_get_zoom_target_max(tevs, &tevs->dz_zoom_max);
+			tevs_get_zoom_target_min(tevs, &tevs->dz_zoom_min);
+			if (!ret)
+				memcpy(ctrl->p_cur.p, ctrl->p_new.p,
+				       ctrl->elems * ctrl->elem_size);
+			break;
+
 		default:
 			break;
 		}
@@ -2116,6 +4390,11 @@ static int tevs_ctrls_init(struct tevs *tevs)
 		return ret;
 	}
 
+	/* s_ctrl can't look these up: it runs with the handler lock held */
+	for (i = 0; i < ARRAY_SIZE(tevs_preset_ctrls); i++)
+		tevs->preset_ctrls[i] = v4l2_ctrl_find(&ctrl_hdl->ctrl_handler,
+						       tevs_preset_ctrls[i]);
+
 	/* Use same lock for controls as for everything else. */
 	ctrl_hdl->ctrl_handler.lock = &tevs->lock;
 	tevs->v4l2_subdev->ctrl_handler = &ctrl_hdl->ctrl_handler;
@@ -2123,14 +4402,302 @@ static int tevs_ctrls_init(struct tevs *tevs)
 	return 0;
 }
 
+/*
+ * frame_meta: one "sample timestamp_ns exposure_us gain" line per
+ * sample, consumed on read. Sampling runs only while the file is open
+ * and the sensor streams. sample counts samples from stream on or open,
+ * not frames. The timestamp is when the values were read over I2C, not
+ * the start of the frame they apply to, so it is only frame exact to
+ * within a frame period plus the bus latency.
+ */
+static int tevs_frame_meta_open(struct inode *inode, struct file *file)
+{
+	struct tevs *tevs = inode->i_private;
+
+	file->private_data = tevs;
+
+	mutex_lock(&tevs->state_lock);
+	tevs->meta_users++;
+	if (tevs->streaming)
+		tevs_meta_start(tevs);
+	mutex_unlock(&tevs->state_lock);
+
+	return nonseekable_open(inode, file);
+}
+
+static int tevs_frame_meta_release(struct inode *inode, struct file *file)
+{
+	struct tevs *tevs = file->private_data;
+
+	mutex_lock(&tevs->state_lock);
+	if (--tevs->meta_users == 0)
+		tevs_meta_stop(tevs);
+	mutex_unlock(&tevs->state_lock);
+
+	return 0;
+}
+
+static ssize_t tevs_frame_meta_read(struct file *file, char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct tevs *tevs = file->private_data;
+	struct tevs_frame_meta meta;
+	char line[64];
+	ssize_t done = 0;
+	int len;
+
+	mutex_lock(&tevs->meta_lock);
+	while (kfifo_peek(&tevs->meta_fifo, &meta)) {
+		len = scnprintf(line, sizeof(line), "%u %llu %u %u\n",
+				meta.sequence, meta.timestamp,
+				meta.exposure, meta.gain);
+		if (done + len > count)
+			break;
+		if (copy_to_user(buf + done, line, len)) {
+			if (done == 0)
+				done = -EFAULT;
+			break;
+		}
+		kfifo_skip(&tevs->meta_fifo);
+		done += len;
+	}
+	mutex_unlock(&tevs->meta_lock);
+
+	return done;
+}
+
+static const struct file_operations tevs_frame_meta_fops = {
+	.owner = THIS_MODULE,
+	.open = tevs_frame_meta_open,
+	.release = tevs_frame_meta_release,
+	.read = tevs_frame_meta_read,
+	.llseek = no_llseek,
+};
+
+/*
+ * sensor_regs: sensor_reg_count registers from sensor_reg_base, read
+ * through the passthrough window in one batch. Writing "reg value"
+ * pairs (hex or decimal, one per line) writes them in one batch.
+ */
+static int tevs_sensor_regs_show(struct seq_file *m, void *unused)
+{
+	struct tevs *tevs = m->private;
+	struct tevs_sensor_reg_op *ops;
+	u32 count = clamp_t(u32, tevs->sensor_reg_count, 1, 256);
+	u32 i;
+	int ret;
+
+	ops = kcalloc(count, sizeof(*ops), GFP_KERNEL);
+	if (ops == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++)
+		ops[i].reg = tevs->sensor_reg_base + i * 2;
+
+	ret = tevs_sensor_reg_batch(tevs->v4l2_subdev, ops, count);
+	if (ret == 0) {
+		for (i = 0; i < count; i++)
+			seq_printf(m, "0x%04x: 0x%04x\n", ops[i].reg, ops[i].val);
+	}
+
+	kfree(ops);
+	return ret;
+}
+
+static int tevs_sensor_regs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, tevs_sensor_regs_show, inode->i_private);
+}
+
+static ssize_t tevs_sensor_regs_write(struct file *file,
+				      const char __user *ubuf, size_t count,
+				      loff_t *ppos)
+{
+	struct tevs *tevs = ((struct seq_file *)file->private_data)->private;
+	struct tevs_sensor_reg_op *ops;
+	char *buf, *line, *cur;
+	unsigned int n = 0;
+	u16 reg, val;
+	int ret = 0;
+
+	if (count > PAGE_SIZE)
+		return -EINVAL;
+
+	buf = memdup_user_nul(ubuf, count);
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+
+	ops = kcalloc(TEVS_SENSOR_REG_BATCH_MAX, sizeof(*ops), GFP_KERNEL);
+	if (ops == NULL) {
+		kfree(buf);
+		return -ENOMEM;
+	}
+
+	cur = buf;
+	while ((line = strsep(&cur, "\n")) != NULL) {
+		if (*skip_spaces(line) == '\0')
+			continue;
+		if (sscanf(line, "%hi %hi", &reg, &val) != 2 ||
+		    n >= TEVS_SENSOR_REG_BATCH_MAX) {
+			ret = -EINVAL;
+			break;
+		}
+		ops[n].reg = reg;
+		ops[n].val = val;
+		ops[n].flags = TEVS_SENSOR_REG_WRITE;
+		n++;
+	}
+
+	if (ret == 0)
+		ret = tevs_sensor_reg_batch(tevs->v4l2_subdev, ops, n);
+
+	kfree(ops);
+	kfree(buf);
+	return ret ? ret : count;
+}
+
+static const struct file_operations tevs_sensor_regs_fops = {
+	.owner = THIS_MODULE,
+	.open = tevs_sensor_regs_open,
+	.read = seq_read,
+	.write = tevs_sensor_regs_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* Pseudo controls without ISP state behind them */
+static bool tevs_ctrl_has_hw_state(u32 id)
+{
+	switch (id) {
+	case V4L2_CID_TEVS_BSL_MODE:
+	case V4L2_CID_TEVS_AE_SEED:
+	case V4L2_CID_TEVS_FW_UPDATE:
+	case V4L2_CID_TEVS_AE_RAMP:
+	case V4L2_CID_TEVS_PRESET_SAVE:
+	case V4L2_CID_TEVS_PRESET_APPLY:
+		return false;
+	default:
+		return true;
+	}
+}
+
+/*
+ * Controls only the host changes are served from the control cache,
+ * which tevs_ctrls_init() seeds from the ISP. For verification they
+ * can be turned volatile so every read goes to the ISP again.
+ */
+static void tevs_set_hw_ctrl_read(struct tevs *tevs, bool enable)
+{
+	struct v4l2_ctrl_handler *hdl = tevs->v4l2_subdev->ctrl_handler;
+	const u32 flags = V4L2_CTRL_FLAG_VOLATILE |
+			  V4L2_CTRL_FLAG_EXECUTE_ON_WRITE;
+	struct v4l2_ctrl *ctrl;
+	int i;
+
+	/* v4l2_ctrl_find() takes hdl->lock itself, so walk the list here */
+	mutex_lock(hdl->lock);
+	list_for_each_entry(ctrl, &hdl->ctrls, node) {
+		for (i = 0; i < ARRAY_SIZE(tevs_ctrls); i++) {
+			if (tevs_ctrls[i].id == ctrl->id)
+				break;
+		}
+		if (i == ARRAY_SIZE(tevs_ctrls) ||
+		    (tevs_ctrls[i].flags & (V4L2_CTRL_FLAG_VOLATILE |
+					    V4L2_CTRL_FLAG_READ_ONLY)) ||
+		    tevs_ctrls[i].type == V4L2_CTRL_TYPE_BUTTON ||
+		    !tevs_ctrl_has_hw_state(ctrl->id))
+			continue;
+
+		if (enable)
+			ctrl->flags |= flags;
+		else
+			ctrl->flags = (ctrl->flags & ~flags) |
+				      (tevs_ctrls[i].flags & flags);
+	}
+	tevs->hw_ctrl_read = enable;
+	mutex_unlock(hdl->lock);
+}
+
+static int tevs_hw_ctrl_read_get(void *data, u64 *val)
+{
+	struct tevs *tevs = data;
+
+	*val = tevs->hw_ctrl_read;
+	return 0;
+}
+
+static int tevs_hw_ctrl_read_set(void *data, u64 val)
+{
+	tevs_set_hw_ctrl_read(data, val != 0);
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(tevs_hw_ctrl_read_fops, tevs_hw_ctrl_read_get,
+			tevs_hw_ctrl_read_set, "%llu\n");
+
+static void tevs_debugfs_init(struct tevs *tevs)
+{
+	char name[32];
+
+	snprintf(name, sizeof(name), "%s-%s", DRIVER_NAME, dev_name(tevs->dev));
+	tevs->debugfs_dir = debugfs_create_dir(name, NULL);
+	if (IS_ERR_OR_NULL(tevs->debugfs_dir)) {
+		tevs->debugfs_dir = NULL;
+		return;
+	}
+
+	debugfs_create_file("frame_meta", 0400, tevs->debugfs_dir, tevs,
+			    &tevs_frame_meta_fops);
+	debugfs_create_u32("frame_meta_overruns", 0400, tevs->debugfs_dir,
+			   &tevs->meta_overruns);
+
+	tevs->sensor_reg_count = 16;
+	debugfs_create_x16("sensor_reg_base", 0600, tevs->debugfs_dir,
+			   &tevs->sensor_reg_base);
+	debugfs_create_u32("sensor_reg_count", 0600, tevs->debugfs_dir,
+			   &tevs->sensor_reg_count);
+	debugfs_create_file("sensor_regs", 0600, tevs->debugfs_dir, tevs,
+			    &tevs_sensor_regs_fops);
+	debugfs_create_file("hw_ctrl_read", 0600, tevs->debugfs_dir, tevs,
+			    &tevs_hw_ctrl_read_fops);
+}
+
 static int tevs_try_on(struct tevs *tevs)
 {
 	tevs_power_off(tevs->s_data);
 	return tevs_power_on(tevs->s_data);
 }
 
+/*
+ * Product names are the table name optionally followed by a variant
+ * suffix, e.g. "TEVS-AR0522-M". Returns the suffix ("" for none) or NULL.
+ */
+static const char *tevs_match_product(const char *product_name,
+				      const char *sensor_name)
+{
+	size_t len = strlen(sensor_name);
+
+	if (strncmp(product_name, sensor_name, len) != 0)
+		return NULL;
+	if (product_name[len] != '\0' && product_name[len] != '-')
+		return NULL;
+
+	return product_name + len;
+}
+
+/*
+ * sensor_type in the header does not encode the colour filter, so mono
+ * variants are recognised by their "-M" product suffix.
+ */
+static bool tevs_is_mono_product(const char *suffix)
+{
+	return suffix && strncmp(suffix, "-M", 2) == 0 &&
+	       (suffix[2] == '\0' || suffix[2] == '-');
+}
+
 static int tevs_setup(struct tevs *tevs)
 {
+	const char *suffix = NULL;
 	int i = 0;
 	int ret = 0;
 
@@ -2186,38 +4753,60 @@ static int tevs_setup(struct tevs *tevs)
 		}
 	}
 
+	tevs->throughput = 0;
+	if (of_property_read_u32(tevs->dev->of_node, "throughput",
+				 &tevs->throughput) == 0) {
+		if (tevs->throughput > tevs_link_capacity(tevs)) {
+			dev_err(tevs->dev,
+				"value of 'throughput = <%d>' property is invaild\n", tevs->throughput);
+			tevs->throughput = 0;
+		}
+	}
+
 	tevs->hw_reset_mode =
 		of_property_read_bool(tevs->dev->of_node, "hw-reset");
 
 	tevs->trigger_mode = 
 		of_property_read_bool(tevs->dev->of_node, "trigger-mode");
 
+	tevs->ae_seed =
+		of_property_read_bool(tevs->dev->of_node, "ae-seed");
+
+	tevs->fw_name = TEVS_FW_DEFAULT_NAME;
+	of_property_read_string(tevs->dev->of_node, "firmware-name",
+				&tevs->fw_name);
+
+	ret = of_property_read_string_array(tevs->dev->of_node, "preset-names",
+					    tevs->preset_names, TEVS_PRESETS);
+	for (i = max(ret, 0); i < TEVS_PRESETS; i++)
+		tevs->preset_names[i] = tevs_preset_strings[i];
+
+	memset(tevs->bsl_password, 0xFF, TEVS_BSL_PASSWORD_LEN);
+	if (of_property_read_u8_array(tevs->dev->of_node, "bsl-password",
+				      tevs->bsl_password,
+				      TEVS_BSL_PASSWORD_LEN) == -EOVERFLOW)
+		dev_warn(tevs->dev, "'bsl-password' must be %d bytes\n",
+			 TEVS_BSL_PASSWORD_LEN);
+
 	dev_dbg(tevs->dev,
 		"data-lanes [%d] ,continuous-clock [%d]," 
-		" hw-reset [%d], trigger-mode [%d]\n",
+		" hw-reset [%d], trigger-mode [%d], throughput [%d],"
+		" ae-seed [%d]\n",
 		tevs->data_lanes, tevs->continuous_clock, 
-		tevs->hw_reset_mode, tevs->trigger_mode);
+		tevs->hw_reset_mode, tevs->trigger_mode, tevs->throughput,
+		tevs->ae_seed);
 
 	if (tevs_try_on(tevs) != 0) {
 		dev_err(tevs->dev, "cannot find tevs camera\n");
 		return -EINVAL;
 	}
 
-	ret = tevs_i2c_write_16b(tevs,
-				HOST_COMMAND_ISP_CTRL_MIPI_FREQ,
-				tevs->data_frequency);
-	msleep(250);
-	if (tevs_check_boot_state(tevs) != 0) {
-		dev_err(tevs->dev, "check tevs bootup status failed\n");
-		return -EINVAL;
-	}
-	if (ret < 0) {
-		dev_err(tevs->dev, "set mipi frequency failed\n");
-		return -EINVAL;
-	}
+	ret = tevs_boot_setting(tevs);
+	if (ret)
+		return ret;
 
 	tevs->header_info = devm_kzalloc(
-			tevs->dev, sizeof(struct header_info), GFP_KERNEL);
+			tevs->dev, sizeof(struct tn_otp_header), GFP_KERNEL);
 	if (tevs->header_info == NULL) {
 		dev_err(tevs->dev, "allocate header_info failed\n");
 		return -EINVAL;
@@ -2235,9 +4824,10 @@ static int tevs_setup(struct tevs *tevs)
 		return -EINVAL;
 	} else {
 		for (i = 0; i < ARRAY_SIZE(tevs_sensor_table); i++) {
-			if (strcmp((const char *)tevs->header_info
-					   ->product_name,
-				   tevs_sensor_table[i].sensor_name) == 0)
+			suffix = tevs_match_product(
+				(const char *)tevs->header_info->product_name,
+				tevs_sensor_table[i].sensor_name);
+			if (suffix != NULL)
 				break;
 		}
 	}
@@ -2250,8 +4840,12 @@ static int tevs_setup(struct tevs *tevs)
 	}
 
 	tevs->selected_sensor = i;
-	dev_dbg(tevs->dev, "selected_sensor:%d, sensor_name:%s\n", i,
-		tevs->header_info->product_name);
+	tevs->mono = tevs_is_mono_product(suffix);
+	tevs->format = tevs_default_format(tevs);
+	tevs->out_width = tevs_sensor_table[i].frmfmt[0].size.width;
+	tevs->out_height = tevs_sensor_table[i].frmfmt[0].size.height;
+	dev_dbg(tevs->dev, "selected_sensor:%d, sensor_name:%s, mono:%d\n", i,
+		tevs->header_info->product_name, tevs->mono);
 
 	switch(tevs->selected_sensor){
 	case TEVS_AR0144:
@@ -2321,9 +4915,7 @@ static int tevs_probe(struct i2c_client *client,
 	tc_dev->dev = dev;
 	tc_dev->dev_regmap_config = &tevs_regmap_config;
 	tc_dev->sensor_ops = &tevs_common_ops;
-#ifdef	__ENABLE_NV_CTRL
 	tc_dev->tcctrl_ops = &tevs_nv_ctrl_ops;
-#endif
 
 	ret = tegracam_device_register(tc_dev);
 	if (ret) {
@@ -2339,6 +4931,20 @@ static int tevs_probe(struct i2c_client *client,
 	tevs->v4l2_subdev->flags |=
 		(V4L2_SUBDEV_FL_HAS_EVENTS | V4L2_SUBDEV_FL_HAS_DEVNODE);
 	tegracam_set_privdata(tc_dev, (void *)tevs);
+	mutex_init(&tevs->ae_lock);
+	mutex_init(&tevs->meta_lock);
+	mutex_init(&tevs->ctrl_lock);
+	mutex_init(&tevs->lock);
+	mutex_init(&tevs->state_lock);
+	INIT_KFIFO(tevs->meta_fifo);
+	INIT_DELAYED_WORK(&tevs->ae_monitor_work, tevs_ae_monitor_work);
+	INIT_DELAYED_WORK(&tevs->ctrl_flush_work, tevs_ctrl_flush_work);
+	INIT_WORK(&tevs->fw_work, tevs_fw_update_work);
+	/*
+	 * tevs_setup() may power on (hw-reset, trigger-mode) before the
+	 * product is known; start from UYVY until it picks the default.
+	 */
+	tevs->format = &tevs_formats[0];
 
 	ret = tevs_setup(tevs);
 	if(ret != 0) {
@@ -2353,12 +4959,20 @@ static int tevs_probe(struct i2c_client *client,
 		return ret;
 	}
 
+	ret = tevs_register_subdev_ops(tevs);
+	if (ret) {
+		dev_err(dev, "failed to hook subdev ops: %d\n", ret);
+		goto error_probe;
+	}
+
 	ret = tevs_ctrls_init(tevs);
 	if (ret) {
 		dev_err(&client->dev, "failed to init controls: %d", ret);
 		goto error_probe;
 	}
 
+	tevs_debugfs_init(tevs);
+
 	if(!(tevs->hw_reset_mode | tevs->trigger_mode)) {
 		ret = tevs_standby(tevs, 1);
 		if (ret != 0) {
@@ -2367,13 +4981,12 @@ static int tevs_probe(struct i2c_client *client,
 		}
 	}
 
-	if (ret == 0)
-		dev_info(dev, "probe success\n");
-	else
-		dev_err(dev, "probe failed\n");
+	dev_info(dev, "probe success\n");
+
+	return 0;
 
 error_probe:
-	mutex_destroy(&tevs->lock);
+	dev_err(dev, "probe failed\n");
 
 	return ret;
 }
@@ -2383,8 +4996,16 @@ static int tevs_remove(struct i2c_client *client)
 	struct camera_common_data *s_data = to_camera_common_data(&client->dev);
 	struct tevs *tevs = (struct tevs *)s_data->priv;
 
+	cancel_delayed_work_sync(&tevs->ae_monitor_work);
+	cancel_work_sync(&tevs->fw_work);
+	cancel_delayed_work_sync(&tevs->ctrl_flush_work);
+	tevs_ae_ramp_stop(tevs);
+	tevs_meta_stop(tevs);
+	debugfs_remove_recursive(tevs->debugfs_dir);
 	tegracam_v4l2subdev_unregister(tevs->tc_dev);
 	tegracam_device_unregister(tevs->tc_dev);
+	mutex_destroy(&tevs->state_lock);
+	mutex_destroy(&tevs->lock);
 	return 0;
 }
 
@@ -120,69 +120,74 @@ static struct sensor_info tevs_sensor_table[] = {
 	},
 };
 #else
-static const int __10fps = 10;
-static const int __15fps = 15;
-static const int __20fps = 20;
-static const int __24fps = 24;
-static const int __30fps = 30;
-static const int __32fps = 32;
-static const int __60fps = 60;
-static const int __120fps = 120;
+/*
+ * Frame rates offered for each mode, highest (the mode default) first.
+ * The selected rate is programmed into PREVIEW_MAX_FPS.
+ */
+static const int __10fps[] = { 10, 5 };
+static const int __15fps[] = { 15, 10, 5 };
+static const int __24fps[] = { 24, 15, 10 };
+static const int __30fps[] = { 30, 15, 10 };
+static const int __32fps[] = { 32, 30, 15 };
+static const int __60fps[] = { 60, 30, 15 };
+static const int __120fps[] = { 120, 60, 30, 15 };
+
+#define TEVS_FPS(fps)	fps, ARRAY_SIZE(fps)
 
 static const struct camera_common_frmfmt sensor_frmfmt[] = {
-	{{640, 480}, &__60fps, 1, 0, 0},
-	{{1280, 720}, &__60fps, 1, 0, 0},
-	{{1920, 1080}, &__60fps, 1, 0, 0},
+	{{640, 480}, TEVS_FPS(__60fps), 0, 0},
+	{{1280, 720}, TEVS_FPS(__60fps), 0, 0},
+	{{1920, 1080}, TEVS_FPS(__60fps), 0, 0},
 };
 
 static const struct camera_common_frmfmt ar0144_frmfmt[] = {
-	{{640, 480}, &__60fps, 1, 0, 0},
-	{{1280, 720}, &__60fps, 1, 0, 0},
-	{{1280, 800}, &__60fps, 1, 0, 0},
+	{{640, 480}, TEVS_FPS(__60fps), 0, 0},
+	{{1280, 720}, TEVS_FPS(__60fps), 0, 0},
+	{{1280, 800}, TEVS_FPS(__60fps), 0, 0},
 };
 static const struct camera_common_frmfmt ar0234_frmfmt[] = {
-	{{640, 480}, &__120fps, 1, 0, 1},
-	{{1280, 720}, &__120fps, 1, 0, 0},
-	{{1920, 1080}, &__60fps, 1, 0, 0},
-	{{1920, 1200}, &__60fps, 1, 0, 0},
+	{{640, 480}, TEVS_FPS(__120fps), 0, 1},
+	{{1280, 720}, TEVS_FPS(__120fps), 0, 0},
+	{{1920, 1080}, TEVS_FPS(__60fps), 0, 0},
+	{{1920, 1200}, TEVS_FPS(__60fps), 0, 0},
 };
 static const struct camera_common_frmfmt ar0521_frmfmt[] = {
-	{{640, 480}, &__120fps, 1, 0, 3},
-	{{1280, 720}, &__60fps, 1, 0, 3},
-	{{1280, 960}, &__60fps, 1, 0, 3},
-	{{1920, 1080}, &__60fps, 1, 0, 1},
-	{{2560, 1440}, &__32fps, 1, 0, 1},
-	{{2592, 1944}, &__24fps, 1, 0, 1},
+	{{640, 480}, TEVS_FPS(__120fps), 0, 3},
+	{{1280, 720}, TEVS_FPS(__60fps), 0, 3},
+	{{1280, 960}, TEVS_FPS(__60fps), 0, 3},
+	{{1920, 1080}, TEVS_FPS(__60fps), 0, 1},
+	{{2560, 1440}, TEVS_FPS(__32fps), 0, 1},
+	{{2592, 1944}, TEVS_FPS(__24fps), 0, 1},
 };
 static const struct camera_common_frmfmt ar0522_frmfmt[] = {
-	{{640, 480}, &__120fps, 1, 0, 3},
-	{{1280, 720}, &__60fps, 1, 0, 3},
-	{{1280, 960}, &__60fps, 1, 0, 3},
-	{{1920, 1080}, &__60fps, 1, 0, 1},
-	{{2560, 1440}, &__32fps, 1, 0, 1},
-	{{2592, 1944}, &__24fps, 1, 0, 1},
+	{{640, 480}, TEVS_FPS(__120fps), 0, 3},
+	{{1280, 720}, TEVS_FPS(__60fps), 0, 3},
+	{{1280, 960}, TEVS_FPS(__60fps), 0, 3},
+	{{1920, 1080}, TEVS_FPS(__60fps), 0, 1},
+	{{2560, 1440}, TEVS_FPS(__32fps), 0, 1},
+	{{2592, 1944}, TEVS_FPS(__24fps), 0, 1},
 };
 static const struct camera_common_frmfmt ar0821_frmfmt[] = {
-	{{640, 480}, &__60fps, 1, 0, 2},
-	{{1280, 720}, &__60fps, 1, 0, 2},
-	{{1920, 1080}, &__60fps, 1, 0, 2},
-	{{2560, 1440}, &__30fps, 1, 0, 0},
-	{{3840, 2160}, &__15fps, 1, 0, 0},
+	{{640, 480}, TEVS_FPS(__60fps), 0, 2},
+	{{1280, 720}, TEVS_FPS(__60fps), 0, 2},
+	{{1920, 1080}, TEVS_FPS(__60fps), 0, 2},
+	{{2560, 1440}, TEVS_FPS(__30fps), 0, 0},
+	{{3840, 2160}, TEVS_FPS(__15fps), 0, 0},
 };
 static const struct camera_common_frmfmt ar0822_frmfmt[] = {
-	{{640, 480}, &__60fps, 1, 0, 1},
-	{{1280, 720}, &__60fps, 1, 0, 1},
-	{{1920, 1080}, &__60fps, 1, 0, 1},
-	{{2560, 1440}, &__30fps, 1, 0, 0},
-	{{3840, 2160}, &__15fps, 1, 0, 0},
+	{{640, 480}, TEVS_FPS(__60fps), 0, 1},
+	{{1280, 720}, TEVS_FPS(__60fps), 0, 1},
+	{{1920, 1080}, TEVS_FPS(__60fps), 0, 1},
+	{{2560, 1440}, TEVS_FPS(__30fps), 0, 0},
+	{{3840, 2160}, TEVS_FPS(__15fps), 0, 0},
 };
 static const struct camera_common_frmfmt ar1335_frmfmt[] = {
-	{{640, 480}, &__60fps, 1, 0, 4},
-	{{1280, 720}, &__120fps, 1, 0, 4},
-	{{1920, 1080}, &__60fps, 1, 0, 3},
-	{{2560, 1440}, &__30fps, 1, 0, 1},
-	{{3840, 2160}, &__15fps, 1, 0, 0},
-	{{4208, 3120}, &__10fps, 1, 0, 0},
+	{{640, 480}, TEVS_FPS(__60fps), 0, 4},
+	{{1280, 720}, TEVS_FPS(__120fps), 0, 4},
+	{{1920, 1080}, TEVS_FPS(__60fps), 0, 3},
+	{{2560, 1440}, TEVS_FPS(__30fps), 0, 1},
+	{{3840, 2160}, TEVS_FPS(__15fps), 0, 0},
+	{{4208, 3120}, TEVS_FPS(__10fps), 0, 0},
 };
 
 struct sensor_info {
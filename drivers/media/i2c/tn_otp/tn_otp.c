@@ -0,0 +1,266 @@
+#include <asm/unaligned.h>
+#include <linux/module.h>
+#include <linux/of.h>
+#include <linux/string.h>
+
+#include "tn_otp.h"
+
+/* Version 2 layout */
+#define V2_CONTENT_OFFSET		(1)
+#define V2_PRODUCT_NAME			(3)
+#define V2_PRODUCT_VERSION		(67)
+#define V2_LENS_NAME			(68)
+#define V2_LENS_VERSION			(132)
+#define V2_CONTENT_VERSION		(133)
+#define V2_CONTENT_CHECKSUM		(134)
+#define V2_CONTENT_LEN			(138)
+#define V2_PLL_BOOTDATA_LEN		(142)
+#define V2_LEN				(144)
+
+/* Version 3 layout */
+#define V3_CONTENT_OFFSET		(1)
+#define V3_SENSOR_TYPE			(3)
+#define V3_SENSOR_FUSEID		(5)
+#define V3_PRODUCT_NAME			(21)
+#define V3_LENS_ID			(85)
+#define V3_FIX_CHECKSUM			(101)
+#define V3_TN_FW_VERSION		(103)
+#define V3_VENDOR_FW_VERSION		(105)
+#define V3_CUSTOM_NUMBER		(107)
+#define V3_BUILD_TIME			(109)
+#define V3_MIPI_DATARATE		(115)
+#define V3_CONTENT_LEN			(117)
+#define V3_CONTENT_CHECKSUM		(121)
+#define V3_TOTAL_CHECKSUM		(123)
+#define V3_LEN				(125)
+
+/* AP1302 host interface, used by the TEVI drivers */
+#define AP1302_CHIP_ID_REG		(0x0000)
+#define AP1302_CHIP_ID			(0x0265)
+#define AP1302_BOOTDATA_CHECKSUM_REG	(0x6134)
+
+int tn_otp_header_len(u8 version)
+{
+	switch (version) {
+	case TN_OTP_HEADER_VER2:
+		return V2_LEN;
+	case TN_OTP_HEADER_VER3:
+		return V3_LEN;
+	default:
+		return -EINVAL;
+	}
+}
+EXPORT_SYMBOL_GPL(tn_otp_header_len);
+
+/* Names are NUL padded; an unterminated or empty one means bad data */
+static int tn_otp_copy_name(char *dst, const u8 *src)
+{
+	size_t len = strnlen((const char *)src, TN_OTP_NAME_LEN);
+
+	if (len == 0 || len == TN_OTP_NAME_LEN)
+		return -EBADMSG;
+
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+	return 0;
+}
+
+static int tn_otp_decode_v2(const u8 *raw, struct tn_otp_header *header)
+{
+	int ret;
+
+	header->content_offset = get_unaligned_le16(&raw[V2_CONTENT_OFFSET]);
+	header->product_version = raw[V2_PRODUCT_VERSION];
+	header->lens_version = raw[V2_LENS_VERSION];
+	header->content_version = raw[V2_CONTENT_VERSION];
+	header->content_checksum =
+		get_unaligned_le32(&raw[V2_CONTENT_CHECKSUM]);
+	header->content_len = get_unaligned_le32(&raw[V2_CONTENT_LEN]);
+	header->pll_bootdata_len =
+		get_unaligned_le16(&raw[V2_PLL_BOOTDATA_LEN]);
+
+	ret = tn_otp_copy_name(header->lens_name, &raw[V2_LENS_NAME]);
+	if (ret)
+		return ret;
+
+	return tn_otp_copy_name(header->product_name, &raw[V2_PRODUCT_NAME]);
+}
+
+static int tn_otp_decode_v3(const u8 *raw, struct tn_otp_header *header)
+{
+	header->content_offset = get_unaligned_le16(&raw[V3_CONTENT_OFFSET]);
+	header->sensor_type = get_unaligned_le16(&raw[V3_SENSOR_TYPE]);
+	memcpy(header->sensor_fuseid, &raw[V3_SENSOR_FUSEID],
+	       sizeof(header->sensor_fuseid));
+	memcpy(header->lens_id, &raw[V3_LENS_ID], sizeof(header->lens_id));
+	header->fix_checksum = get_unaligned_le16(&raw[V3_FIX_CHECKSUM]);
+	header->tn_fw_version[0] = raw[V3_TN_FW_VERSION];
+	header->tn_fw_version[1] = raw[V3_TN_FW_VERSION + 1];
+	header->vendor_fw_version =
+		get_unaligned_le16(&raw[V3_VENDOR_FW_VERSION]);
+	header->custom_number = get_unaligned_le16(&raw[V3_CUSTOM_NUMBER]);
+	header->build_year = raw[V3_BUILD_TIME + 0];
+	header->build_month = raw[V3_BUILD_TIME + 1];
+	header->build_day = raw[V3_BUILD_TIME + 2];
+	header->build_hour = raw[V3_BUILD_TIME + 3];
+	header->build_minute = raw[V3_BUILD_TIME + 4];
+	header->build_second = raw[V3_BUILD_TIME + 5];
+	header->mipi_datarate = get_unaligned_le16(&raw[V3_MIPI_DATARATE]);
+	header->content_len = get_unaligned_le32(&raw[V3_CONTENT_LEN]);
+	header->content_checksum =
+		get_unaligned_le16(&raw[V3_CONTENT_CHECKSUM]);
+	header->total_checksum = get_unaligned_le16(&raw[V3_TOTAL_CHECKSUM]);
+
+	return tn_otp_copy_name(header->product_name, &raw[V3_PRODUCT_NAME]);
+}
+
+/*
+ * Decode and sanity check a header. raw must hold at least the header
+ * length of its version. An erased header already fails on its version
+ * byte; empty names and content that overlaps the header are rejected
+ * with -EBADMSG so callers fail before uploading any bootdata. 0xFFFF
+ * is a valid checksum value and is not treated as erased.
+ *
+ * The checksum fields themselves are not verified here: the algorithm
+ * behind fix_checksum/total_checksum is not documented, and the TEVI
+ * drivers compare content_checksum with the one the ISP reports after
+ * the upload. Nor is the content checked against the flash size, which
+ * none of the callers know.
+ */
+int tn_otp_parse_header(struct device *dev, const u8 *raw, size_t len,
+			struct tn_otp_header *header)
+{
+	int header_len;
+	int ret;
+
+	if (len < 1)
+		return -EINVAL;
+
+	header_len = tn_otp_header_len(raw[0]);
+	if (header_len < 0) {
+		dev_err(dev, "can't recognize header version number '0x%X'\n",
+			raw[0]);
+		return header_len;
+	}
+	if (len < header_len)
+		return -EINVAL;
+
+	memset(header, 0, sizeof(*header));
+	header->header_version = raw[0];
+	header->header_len = header_len;
+
+	if (header->header_version == TN_OTP_HEADER_VER2)
+		ret = tn_otp_decode_v2(raw, header);
+	else
+		ret = tn_otp_decode_v3(raw, header);
+	if (ret) {
+		dev_err(dev, "header version %d is corrupt\n",
+			header->header_version);
+		return ret;
+	}
+
+	if (header->content_offset < header_len ||
+	    header->content_len == 0 ||
+	    header->pll_bootdata_len > header->content_len) {
+		dev_err(dev, "bad content: offset %u, length %u\n",
+			header->content_offset, header->content_len);
+		return -EBADMSG;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(tn_otp_parse_header);
+
+/*
+ * Bytes of bootdata carried by one write burst. Defaults to the whole
+ * bootdata window, capped by what the adapter can send in a single
+ * message (2 bytes go to the register address). "bootdata-chunk-size"
+ * in the device tree can lower it for buses that misbehave on long
+ * transfers.
+ */
+size_t tn_otp_bootdata_chunk_len(struct i2c_client *client, size_t window)
+{
+	const struct i2c_adapter_quirks *quirks = client->adapter->quirks;
+	size_t chunk = window;
+	u32 val;
+
+	if (of_property_read_u32(client->dev.of_node, "bootdata-chunk-size",
+				 &val) == 0 && val > 2)
+		chunk = min_t(size_t, chunk, val);
+
+	if (quirks && quirks->max_write_len > 2)
+		chunk = min_t(size_t, chunk, quirks->max_write_len - 2);
+
+	/* registers are 16 bit wide, keep every burst word aligned */
+	return max_t(size_t, chunk & ~1, 2);
+}
+EXPORT_SYMBOL_GPL(tn_otp_bootdata_chunk_len);
+
+/* A chip held in reset is the normal case, so failures are not logged */
+static int tn_otp_ap1302_read_16b(struct i2c_client *client, u16 reg,
+				  u16 *val)
+{
+	u8 addr[2] = { reg >> 8, reg & 0xff };
+	u8 buf[2];
+	struct i2c_msg msg[2] = {
+		{
+			.addr = client->addr,
+			.flags = client->flags,
+			.buf = addr,
+			.len = sizeof(addr),
+		}, {
+			.addr = client->addr,
+			.flags = client->flags | I2C_M_RD,
+			.buf = buf,
+			.len = sizeof(buf),
+		},
+	};
+
+	if (i2c_transfer(client->adapter, msg, 2) != 2)
+		return -EIO;
+
+	*val = get_unaligned_be16(buf);
+	return 0;
+}
+
+/*
+ * After a module reload or unbind/bind the AP1302 is usually still
+ * powered, out of reset and parked in standby by the previous probe.
+ * Only then is it worth keeping it out of reset to look at what it runs.
+ */
+bool tn_otp_ap1302_alive(struct i2c_client *client)
+{
+	u16 id;
+
+	return tn_otp_ap1302_read_16b(client, AP1302_CHIP_ID_REG, &id) == 0 &&
+	       id == AP1302_CHIP_ID;
+}
+EXPORT_SYMBOL_GPL(tn_otp_ap1302_alive);
+
+/*
+ * rel419 firmware keeps the checksum of the bootdata it runs in 0x6134,
+ * so a warm chip can be matched against the header. Current firmware
+ * reports 0xFFFF there once booted, which says nothing about the
+ * bootdata it runs; such a chip is always reloaded.
+ */
+bool tn_otp_ap1302_bootdata_loaded(struct i2c_client *client, u16 checksum)
+{
+	u16 val;
+
+	if (tn_otp_ap1302_read_16b(client, AP1302_BOOTDATA_CHECKSUM_REG,
+				   &val) != 0)
+		return false;
+
+	if (val == U16_MAX || val != checksum) {
+		dev_dbg(&client->dev, "running checksum %x, expected %x\n",
+			val, checksum);
+		return false;
+	}
+
+	return true;
+}
+EXPORT_SYMBOL_GPL(tn_otp_ap1302_bootdata_loaded);
+
+MODULE_AUTHOR("TechNexion");
+MODULE_DESCRIPTION("TechNexion camera OTP/bootdata helpers");
+MODULE_LICENSE("GPL v2");
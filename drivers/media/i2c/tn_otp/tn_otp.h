@@ -0,0 +1,60 @@
+#ifndef __TN_OTP_H__
+#define __TN_OTP_H__
+
+#include <linux/device.h>
+#include <linux/i2c.h>
+#include <linux/types.h>
+
+/*
+ * Header at the start of the bootdata content, stored in the module
+ * EEPROM (TEVI) or exposed by the MCU bootdata page (TEVS). All
+ * multi-byte fields are little endian.
+ */
+
+#define TN_OTP_HEADER_VER2		(2)
+#define TN_OTP_HEADER_VER3		(3)
+/* enough bytes for every known header version */
+#define TN_OTP_HEADER_MAX_LEN		(144)
+#define TN_OTP_NAME_LEN			(64)
+
+struct tn_otp_header {
+	u8 header_version;
+	u16 header_len;
+	u16 content_offset;
+	u32 content_len;
+	u32 content_checksum;
+	char product_name[TN_OTP_NAME_LEN + 1];
+
+	/* version 2 only */
+	u8 product_version;
+	char lens_name[TN_OTP_NAME_LEN + 1];
+	u8 lens_version;
+	u8 content_version;
+	u16 pll_bootdata_len;
+
+	/* version 3 only */
+	u16 sensor_type;
+	u8 sensor_fuseid[16];
+	u8 lens_id[16];
+	u16 fix_checksum;
+	u8 tn_fw_version[2];
+	u16 vendor_fw_version;
+	u16 custom_number;
+	u8 build_year;
+	u8 build_month;
+	u8 build_day;
+	u8 build_hour;
+	u8 build_minute;
+	u8 build_second;
+	u16 mipi_datarate;
+	u16 total_checksum;
+};
+
+int tn_otp_header_len(u8 version);
+int tn_otp_parse_header(struct device *dev, const u8 *raw, size_t len,
+			struct tn_otp_header *header);
+size_t tn_otp_bootdata_chunk_len(struct i2c_client *client, size_t window);
+bool tn_otp_ap1302_alive(struct i2c_client *client);
+bool tn_otp_ap1302_bootdata_loaded(struct i2c_client *client, u16 checksum);
+
+#endif //__TN_OTP_H__